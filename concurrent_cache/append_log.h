@@ -0,0 +1,301 @@
+#ifndef APPEND_LOG_H
+#define APPEND_LOG_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "cache_options.h"
+#include "codec.h"
+
+
+namespace concurrent_cache{
+
+
+// append-only file of key/value records, each record is
+//     [key length : u32][value length : u32][checksum of key and value : u32][key][value]
+// header fields are little-endian, like arithmetic values of Codec, so log is portable between hosts. Removal of
+// a key is a record with removedMarker in place of value length and no value
+// later record of the same key overrides earlier ones. Record torn by crash fails the checksum (or is short),
+// replay stops on it and cuts it off, so log always ends with a whole record after startup
+class AppendLog : boost::noncopyable  {
+    public:
+        AppendLog(const std::string& fileName, const DbOptions& options);
+        ~AppendLog();
+
+        // visitor(const ByteView& key, const ByteView& value) is called for every valid record in order,
+        // removalVisitor(const ByteView& key) for removal records among them
+        template<typename Visitor, typename RemovalVisitor>
+        void replay(Visitor visitor, RemovalVisitor removalVisitor);
+        void append(const ByteView& key, const ByteView& value);
+        void appendRemoval(const ByteView& key);
+        // write buffered records and fsync them according to policy
+        void flush();
+        // replace log with records enumerated by forEachRecord(appender), appender(key, value) takes a record
+        template<typename ForEachRecord>
+        void compact(ForEachRecord forEachRecord);
+        // bytes written and buffered
+        std::uint64_t size() const;
+
+        static std::uint64_t recordSize(std::size_t keySize, std::size_t valueSize){
+            return headerSize + keySize + valueSize;
+        }
+
+    private:
+        static const std::size_t headerSize = 3 * sizeof(std::uint32_t);
+        // sanity limit for replay, length beyond it means garbage in the header
+        static const std::uint32_t maxFieldSize = 1u << 30;
+        static const std::uint32_t removedMarker = 0xFFFFFFFFu;
+
+        static std::uint32_t checksum(const ByteView& key, const ByteView& value);
+        // valueSize is value.size, or removedMarker for removal record with empty value
+        static void encode(std::string& buf, const ByteView& key, const ByteView& value, std::uint32_t valueSize);
+        // buffered record is written according to batch size and fsync policy
+        void appendEncoded();
+        void writeAll(int fd, const std::string& buf);
+        void fsync(int fd);
+        void open();
+        void throwIoError(const char* operation);
+
+        std::string fileName_;
+        DbOptions options_;
+        int fd_;
+        std::uint64_t fileSize_;
+        std::string buffer_;
+};
+
+
+inline AppendLog::AppendLog(const std::string& fileName, const DbOptions& options)
+    :fileName_{fileName},
+     options_(options),
+     fd_{-1},
+     fileSize_{0}{
+    open();
+}
+
+
+inline AppendLog::~AppendLog() {
+    try{
+        flush();
+    } catch (const std::exception& ex){
+        std::cerr << ex.what() << std::endl; // log somewhere
+    } catch(...){
+        std::cerr << "unexpected exception" << std::endl; // log somewhere
+    }
+    ::close(fd_);
+}
+
+
+template<typename Visitor, typename RemovalVisitor>
+void AppendLog::replay(Visitor visitor, RemovalVisitor removalVisitor) {
+    std::ifstream logFile{fileName_, std::ios::in | std::ios::binary};
+    if(!logFile){
+        throwIoError("open");
+    }
+
+    std::uint64_t validSize{0};
+    std::string key;
+    std::string value;
+    while(1){
+        char headerBytes[headerSize];
+        if(!logFile.read(headerBytes, headerSize)){
+            break;
+        }
+        std::uint32_t header[3];
+        for(std::size_t field = 0; field < 3; ++field){
+            Codec<std::uint32_t>::decode(headerBytes + field * sizeof(std::uint32_t), sizeof(std::uint32_t),
+                                         header[field]);
+        }
+        bool removal = removedMarker == header[1];
+        if(header[0] > maxFieldSize || (header[1] > maxFieldSize && !removal)){
+            break;
+        }
+        key.resize(header[0]);
+        value.resize(removal ? 0 : header[1]);
+        if(!logFile.read(&key[0], key.size()) || !logFile.read(&value[0], value.size())){
+            break;
+        }
+        const ByteView keyBytes{key.data(), key.size()};
+        const ByteView valueBytes{value.data(), value.size()};
+        if(checksum(keyBytes, valueBytes) != header[2]){
+            break;
+        }
+        if(removal){
+            removalVisitor(keyBytes);
+        } else {
+            visitor(keyBytes, valueBytes);
+        }
+        validSize += recordSize(key.size(), value.size());
+    }
+
+    if(validSize < fileSize_){
+        // torn tail, drop it so new records aren't appended after garbage
+        if(0 != ::ftruncate(fd_, validSize)){
+            throwIoError("truncate");
+        }
+        fileSize_ = validSize;
+    }
+}
+
+
+inline void AppendLog::append(const ByteView& key, const ByteView& value) {
+    encode(buffer_, key, value, static_cast<std::uint32_t>(value.size));
+    appendEncoded();
+}
+
+
+inline void AppendLog::appendRemoval(const ByteView& key) {
+    encode(buffer_, key, ByteView{nullptr, 0}, removedMarker);
+    appendEncoded();
+}
+
+
+inline void AppendLog::appendEncoded() {
+    if(DbOptions::FsyncPolicy::always == options_.fsyncPolicy || buffer_.size() >= options_.writeBatchBytes){
+        flush();
+    }
+}
+
+
+inline void AppendLog::flush() {
+    if(buffer_.empty()){
+        return;
+    }
+    writeAll(fd_, buffer_);
+    fileSize_ += buffer_.size();
+    buffer_.clear();
+    if(DbOptions::FsyncPolicy::none != options_.fsyncPolicy){
+        fsync(fd_);
+    }
+}
+
+
+template<typename ForEachRecord>
+void AppendLog::compact(ForEachRecord forEachRecord) {
+    flush();
+
+    // new log is written aside and renamed over the old one, so crash during compaction leaves old log intact
+    const std::string compactedName{fileName_ + ".compact"};
+    int compactedFd = ::open(compactedName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(compactedFd < 0){
+        throwIoError("open");
+    }
+    std::uint64_t compactedSize{0};
+    try{
+        std::string buf;
+        forEachRecord([this, &buf, &compactedSize, compactedFd](const ByteView& key, const ByteView& value){
+            encode(buf, key, value, static_cast<std::uint32_t>(value.size));
+            if(buf.size() >= options_.writeBatchBytes){
+                writeAll(compactedFd, buf);
+                compactedSize += buf.size();
+                buf.clear();
+            }
+        });
+        writeAll(compactedFd, buf);
+        compactedSize += buf.size();
+        if(DbOptions::FsyncPolicy::none != options_.fsyncPolicy){
+            fsync(compactedFd);
+        }
+    } catch(...){
+        ::close(compactedFd);
+        ::unlink(compactedName.c_str());
+        throw;
+    }
+    ::close(compactedFd);
+
+    if(0 != std::rename(compactedName.c_str(), fileName_.c_str())){
+        ::unlink(compactedName.c_str());
+        throwIoError("rename");
+    }
+    ::close(fd_);
+    fd_ = -1;
+    open();
+    fileSize_ = compactedSize;
+}
+
+
+inline std::uint64_t AppendLog::size() const {
+    return fileSize_ + buffer_.size();
+}
+
+
+inline std::uint32_t AppendLog::checksum(const ByteView& key, const ByteView& value) {
+    // FNV-1a, enough to detect torn writes, not a protection from deliberate corruption
+    std::uint32_t hash{2166136261u};
+    for(std::size_t index = 0; index < key.size; ++index){
+        hash = (hash ^ static_cast<unsigned char>(key.data[index])) * 16777619u;
+    }
+    // separate key and value, so moving bytes between them changes checksum
+    hash = (hash ^ 0xFFu) * 16777619u;
+    for(std::size_t index = 0; index < value.size; ++index){
+        hash = (hash ^ static_cast<unsigned char>(value.data[index])) * 16777619u;
+    }
+    return hash;
+}
+
+
+inline void AppendLog::encode(std::string& buf, const ByteView& key, const ByteView& value, std::uint32_t valueSize) {
+    const std::uint32_t header[3] = {static_cast<std::uint32_t>(key.size),
+                                     valueSize,
+                                     checksum(key, value)};
+    char headerBytes[headerSize];
+    for(std::size_t field = 0; field < 3; ++field){
+        Codec<std::uint32_t>::encode(header[field], headerBytes + field * sizeof(std::uint32_t));
+    }
+    buf.append(headerBytes, headerSize);
+    buf.append(key.data, key.size);
+    buf.append(value.data, value.size);
+}
+
+
+inline void AppendLog::writeAll(int fd, const std::string& buf) {
+    std::size_t written{0};
+    while(written < buf.size()){
+        auto res = ::write(fd, buf.data() + written, buf.size() - written);
+        if(res < 0){
+            if(EINTR == errno){
+                continue;
+            }
+            throwIoError("write");
+        }
+        written += static_cast<std::size_t>(res);
+    }
+}
+
+
+inline void AppendLog::fsync(int fd) {
+    if(0 != ::fsync(fd)){
+        throwIoError("fsync");
+    }
+}
+
+
+inline void AppendLog::open() {
+    fd_ = ::open(fileName_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd_ < 0){
+        throwIoError("open");
+    }
+    struct stat fileStat;
+    if(0 != ::fstat(fd_, &fileStat)){
+        throwIoError("stat");
+    }
+    fileSize_ = static_cast<std::uint64_t>(fileStat.st_size);
+}
+
+
+inline void AppendLog::throwIoError(const char* operation) {
+    throw DbIoException(std::string{"Append log "} + operation + " failed for " + fileName_ + ": " +
+                        std::strerror(errno));
+}
+
+
+} // namespace
+#endif // APPEND_LOG_H
@@ -0,0 +1,59 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <chrono>
+#include <thread>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace concurrent_cache{
+
+
+// tells the core that caller busy waits, so sibling hyperthread gets the pipeline
+inline void cpuRelax(){
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+
+// waiting strategy of lock retry loops: spins for doubling number of pauses first, expecting the owner to finish
+// soon, then yields time slice, then sleeps for doubling periods, so long waiters neither burn a core nor keep
+// scheduler busy. Sleep is capped, so waiter notices free lock or its deadline soon enough
+class Backoff{
+    public:
+        Backoff()
+            :round_{0}{}
+
+        void pause();
+
+    private:
+        static const unsigned int spinRounds = 7;    // up to 64 pauses
+        static const unsigned int yieldRounds = 16;
+        static const unsigned int sleepRounds = 9;   // 1 to 256 microseconds
+
+        unsigned int round_;
+};
+
+
+inline void Backoff::pause() {
+    if(round_ < spinRounds){
+        for(unsigned int spin = 0; spin < (1u << round_); ++spin){
+            cpuRelax();
+        }
+    } else if(round_ < spinRounds + yieldRounds){
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds{1u << (round_ - spinRounds - yieldRounds)});
+    }
+    // the last round repeats
+    if(round_ + 1 < spinRounds + yieldRounds + sleepRounds){
+        ++round_;
+    }
+}
+
+
+} // namespace
+#endif // BACKOFF_H
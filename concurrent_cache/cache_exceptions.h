@@ -51,6 +51,14 @@ class DbParseException : public std::logic_error{
 };
 
 
+class DbIoException : public std::logic_error{
+    public:
+        DbIoException(const std::string& message)
+            :std::logic_error{message}{
+        }
+};
+
+
 class CacheInternalException : public std::logic_error{
     public:
         CacheInternalException(const char* message)
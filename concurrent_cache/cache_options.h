@@ -0,0 +1,84 @@
+#ifndef CACHE_OPTIONS_H
+#define CACHE_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace concurrent_cache{
+
+
+struct DbOptions{
+        enum class Format{
+            jsonDump,       // whole db is kept in memory and dumped to json file by sync passes which modified
+                            // it and on shutdown; always fsync policy acts as onFlush
+            appendLog,      // every update is appended to binary log, db is restored by log replay on startup
+            mappedHashTable // hash table file mapped to memory, only the index is read on startup, only touched
+                            // pages of records are loaded
+        };
+        enum class FsyncPolicy{
+            none,      // leave it to OS, crash of the host may lose recently written records
+            onFlush,   // fsync once per batch written (each sync pass of the cache)
+            always     // write and fsync every record, slowest
+        };
+
+        Format format{Format::jsonDump};
+        // file of the db, empty - db.json, db.log or db.bin in working directory, depending on format; caches
+        // sharing a process need files of their own
+        std::string path;
+        // msync of mappedHashTable follows the same policy
+        FsyncPolicy fsyncPolicy{FsyncPolicy::onFlush};
+        // options below are used by appendLog format only
+        // appended records are buffered and written by single write() once buffer reaches this size or on flush
+        std::size_t writeBatchBytes{64 * 1024};
+        // log is rewritten with live records only when it exceeds both this size and compactionRatio times
+        // size of live records
+        std::uint64_t compactionMinBytes{1024 * 1024};
+        std::uint64_t compactionRatio{2};
+};
+
+
+struct CacheOptions{
+        enum class WritePolicy{
+            writeBack,   // updates reach db by sync thread, within sync period or write behind delay
+            writeThrough // update returns once its value is written to db (and fsynced under onFlush and always
+                         // policies); concurrent updates are written by the same sync pass (group commit)
+        };
+
+        // number of independent lock stripes, each shard owns its own slice of records, lifetime manager and
+        // size counter, so misses on different shards don't block each other
+        std::size_t shardsCount{1};
+        // threads reading misses of findAsync from db
+        std::size_t loaderThreadsCount{2};
+        // record expires this long after it was loaded or updated, zero - never
+        std::chrono::milliseconds expireAfterWrite{0};
+        // record expires this long after it was loaded, updated or found, zero - never; only one of expiry
+        // policies may be set. Expired records are reloaded from db by lookups and reclaimed by sync thread
+        std::chrono::milliseconds expireAfterAccess{0};
+        // eviction watermarks, percents of shard capacity. Insertion into full shard evicts a batch of records
+        // down to the low watermark, and shard grown over the high watermark is trimmed down to the low one by
+        // loader thread, so misses of a busy cache rarely evict anything themselves (e.g. 95 and 90).
+        // Both 100 - every insertion into full shard evicts just enough records to fit
+        unsigned int evictionHighWatermarkPercent{100};
+        unsigned int evictionLowWatermarkPercent{100};
+        // bits per key of presence filter, zero - no filter. Filter is built of db keys on startup and gets keys of
+        // updates, lookups of keys it doesn't have return default value without db read, and keys db turns out not
+        // to have are remembered in small per shard table instead of being cached as records (10 bits per key give
+        // about 1% of absent keys read from db). Filter capacity is twice the keys db has on startup,
+        // at least 65536 keys
+        unsigned int presenceFilterBitsPerKey{0};
+        // sync thread flushes as soon as this many records turned dirty since its last pass, not waiting for
+        // the sync period to end; zero - once per period only
+        std::uint64_t syncDirtyThreshold{0};
+        // write behind: the first record turned dirty after a sync pass wakes sync thread, which writes it along
+        // with records turned dirty within this delay, so update reaches db within the delay plus a pass rather
+        // than within sync period; zero - once per period only
+        std::chrono::milliseconds writeBehindDelay{0};
+        WritePolicy writePolicy{WritePolicy::writeBack};
+        DbOptions db;
+};
+
+
+} // namespace
+#endif // CACHE_OPTIONS_H
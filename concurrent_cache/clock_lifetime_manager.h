@@ -0,0 +1,118 @@
+#ifndef CLOCK_LIFETIME_MANAGER_H
+#define CLOCK_LIFETIME_MANAGER_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "record_lifetime_manager.h"
+
+
+namespace concurrent_cache{
+
+
+// second chance: hit only sets referenced bit of the record, so concurrent hits don't take any lock,
+// clock hand clears the bits and evicts first record which wasn't referenced since the previous round
+template<typename Record>
+class ClockRecordLifetimeManager : boost::noncopyable  {
+    public:
+        ClockRecordLifetimeManager();
+        void addRecord(const Record& record);
+        void touch(const Record& record);
+        std::shared_ptr<Record> getRecordToRemove();
+        // record leaves the cache other way than eviction (e.g. expires), record must be managed
+        void removeRecord(const Record& record);
+
+    private:
+        typedef RecordTraits<Record> Traits;
+
+        struct Slot{
+                Record record;
+                std::atomic<bool> referenced;
+                Slot(const Record& rec)
+                    :record(rec),
+                     referenced{false}{}
+        };
+        typedef typename std::list<Slot>::iterator Position;
+
+        std::list<Slot> ring_;
+        Position hand_;
+        // touch only reads this map, it's modified under cache exclusive lock only
+        std::unordered_map<typename Traits::Id, Position> positions_;
+};
+
+
+template<typename Record>
+ClockRecordLifetimeManager<Record>::ClockRecordLifetimeManager()
+    :hand_{std::end(ring_)}{
+}
+
+
+template<typename Record>
+void ClockRecordLifetimeManager<Record>::addRecord(const Record& record) {
+    // new record goes right behind the hand, so it's visited last
+    auto position = ring_.emplace(hand_, record);
+    try{
+        if(!positions_.emplace(Traits::id(record), position).second){
+            ring_.erase(position);
+            this->touch(record);
+        }
+    } catch(...){
+        ring_.erase(position);
+        throw;
+    }
+}
+
+
+template<typename Record>
+void ClockRecordLifetimeManager<Record>::touch(const Record& record) {
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        (*(*positionFound).second).referenced.store(true, std::memory_order_relaxed);
+    }
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> ClockRecordLifetimeManager<Record>::getRecordToRemove(){
+    if(ring_.empty()){
+        throw QueueEmpty();
+    }
+    // finishes in two rounds at most, first one clears all referenced bits
+    while(1){
+        if(std::end(ring_) == hand_){
+            hand_ = std::begin(ring_);
+        }
+        if((*hand_).referenced.exchange(false, std::memory_order_relaxed)){
+            ++hand_;
+            continue;
+        }
+        std::shared_ptr<Record> recordToRemove{std::make_shared<Record>((*hand_).record)};
+        positions_.erase(Traits::id((*hand_).record));
+        hand_ = ring_.erase(hand_);
+        return recordToRemove;
+    }
+}
+
+
+template<typename Record>
+void ClockRecordLifetimeManager<Record>::removeRecord(const Record& record){
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) == positionFound){
+        return;
+    }
+    auto position = (*positionFound).second;
+    positions_.erase(positionFound);
+    // hand moves to the next record, as if removed one was evicted
+    if(hand_ == position){
+        hand_ = ring_.erase(position);
+    } else {
+        ring_.erase(position);
+    }
+}
+
+
+} // namespace
+#endif // CLOCK_LIFETIME_MANAGER_H
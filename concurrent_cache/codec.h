@@ -0,0 +1,130 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+
+
+namespace concurrent_cache{
+
+
+// non owning range of encoded bytes
+struct ByteView{
+        const char* data;
+        std::size_t size;
+};
+
+
+// Codec<T> converts keys and values to bytes stored by binary backends (append log, mapped hash table).
+// Specialize it for own types, specialization provides
+//     static std::size_t size(const T& value);              - count of bytes encode will write
+//     static void encode(const T& value, char* out);        - write exactly size(value) bytes
+//     static std::size_t decode(const char* in, std::size_t size, T& value);
+//                                                           - read value from at most size bytes, return bytes
+//                                                             consumed, throw DbParseException on malformed input
+// and may compose codecs of its fields
+template<typename T, typename Enable = void>
+struct Codec;
+
+
+inline bool littleEndianHost(){
+    const std::uint16_t probe{1};
+    return 1 == *reinterpret_cast<const unsigned char*>(&probe);
+}
+
+
+// arithmetic types are stored as fixed width little-endian
+template<typename T>
+struct Codec<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>{
+        static std::size_t size(const T&){
+            return sizeof(T);
+        }
+        static void encode(const T& value, char* out){
+            std::memcpy(out, &value, sizeof(T));
+            if(!littleEndianHost()){
+                std::reverse(out, out + sizeof(T));
+            }
+        }
+        static std::size_t decode(const char* in, std::size_t size, T& value){
+            if(size < sizeof(T)){
+                throw DbParseException("Truncated arithmetic value");
+            }
+            if(littleEndianHost()){
+                std::memcpy(&value, in, sizeof(T));
+            } else {
+                char reversed[sizeof(T)];
+                std::reverse_copy(in, in + sizeof(T), reversed);
+                std::memcpy(&value, reversed, sizeof(T));
+            }
+            return sizeof(T);
+        }
+};
+
+
+// strings are stored as u32 length followed by bytes
+template<>
+struct Codec<std::string>{
+        static std::size_t size(const std::string& value){
+            return sizeof(std::uint32_t) + value.size();
+        }
+        static void encode(const std::string& value, char* out){
+            Codec<std::uint32_t>::encode(static_cast<std::uint32_t>(value.size()), out);
+            std::memcpy(out + sizeof(std::uint32_t), value.data(), value.size());
+        }
+        static std::size_t decode(const char* in, std::size_t size, std::string& value){
+            std::uint32_t length;
+            auto consumed = Codec<std::uint32_t>::decode(in, size, length);
+            if(size - consumed < length){
+                throw DbParseException("Truncated string value");
+            }
+            value.assign(in + consumed, length);
+            return consumed + length;
+        }
+};
+
+
+// encoded bytes of a value, small encodings (all arithmetic types) are kept inline and don't allocate
+template<typename T>
+class Encoded : boost::noncopyable  {
+    public:
+        explicit Encoded(const T& value)
+            :data_{inline_},
+             size_{Codec<T>::size(value)}{
+            if(size_ > inlineSize){
+                heap_.resize(size_);
+                data_ = &heap_[0];
+            }
+            Codec<T>::encode(value, data_);
+        }
+
+        ByteView view() const{
+            return ByteView{data_, size_};
+        }
+
+    private:
+        static const std::size_t inlineSize = 32;
+
+        char inline_[inlineSize];
+        std::string heap_;
+        char* data_;
+        std::size_t size_;
+};
+
+
+// decode value occupying all the bytes
+template<typename T>
+void decode(const ByteView& bytes, T& value){
+    if(bytes.size != Codec<T>::decode(bytes.data, bytes.size, value)){
+        throw DbParseException("Trailing bytes after encoded value");
+    }
+}
+
+
+} // namespace
+#endif // CODEC_H
@@ -1,21 +1,44 @@
 #ifndef CONCURRENT_CACHE_H
 #define CONCURRENT_CACHE_H
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
+#include <vector>
 #include <unordered_map>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <chrono>
 #include <thread>
 #include <future>
 #include <memory>
 #include <functional>
+#include <iterator>
+#include <string>
+#include <utility>
 #include "boost/noncopyable.hpp"
+#include "boost/optional.hpp"
 #include "boost/thread/locks.hpp"
-#include "boost/thread/shared_mutex.hpp"
+#include "boost/thread/mutex.hpp"
 #include "cache_exceptions.h"
+#include "cache_options.h"
+#include "flat_hash_map.h"
+#include "read_mostly_mutex.h"
+#include "record_lock.h"
+#include "task_pool.h"
+#include "timing_wheel.h"
+#include "presence_filter.h"
+#include "write_behind_queue.h"
+#include "weigher.h"
+#include "thread_slots.h"
 #include "record_lifetime_manager.h"
+#include "lru_lifetime_manager.h"
+#include "clock_lifetime_manager.h"
+#include "s3fifo_lifetime_manager.h"
+#include "tinylfu_lifetime_manager.h"
 #include "simple_db.h"
+#include "null_backend.h"
 
 namespace concurrent_cache{
 
@@ -27,87 +50,475 @@ void checkLock(Lock& lock){
 }
 
 
-template<typename Key, typename Value, typename Hasher = std::hash<Key>>
+struct CacheStats{
+        std::uint64_t hits{0};
+        std::uint64_t misses{0};
+};
+
+
+// why record left the cache, passed to removal listener
+enum class RemovalCause{
+    evicted, // lifetime manager picked it to make room
+    expired, // expiry policy or time to live deadline passed
+    removed  // remove() was called for its key
+};
+
+
+// LifetimeManager decides which record is evicted when shard is full, see CacheRecordLifetimeManager (FIFO),
+// LruRecordLifetimeManager, ClockRecordLifetimeManager, S3FifoRecordLifetimeManager, TinyLfuRecordLifetimeManager.
+// Weigher gives weight of a record, maxSize limits total weight: count of records with UnitWeigher, approximate
+// bytes with ByteWeigher. Backend stores records behind the cache, SimpleDB or NullBackend for pure caching, see
+// null_backend.h for what backend provides
+template<typename Key,
+         typename Value,
+         typename Hasher = std::hash<Key>,
+         template<typename> class LifetimeManager = CacheRecordLifetimeManager,
+         typename Weigher = UnitWeigher<Key, Value>,
+         typename Backend = SimpleDB<Key, Value>>
 class ConcurrentCache : private boost::noncopyable {
     public:
+        // called with every evicted, expired or removed record after its unsynced value is written to (or its key
+        // is deleted from) db, by the thread which caused the removal (caller of find/update/remove, loader or
+        // sync thread) without shard or write back locks held, so listener may use the cache; exceptions thrown
+        // by listener are ignored
+        typedef std::function<void(const Key&, const Value&, RemovalCause)> RemovalListener;
+
         ConcurrentCache(std::uint64_t maxSize,
                         const std::chrono::milliseconds& syncPeriodMs,
-                        const boost::chrono::microseconds& getAccessTimeoutUs);
+                        const boost::chrono::microseconds& getAccessTimeoutUs,
+                        const CacheOptions& options = CacheOptions(),
+                        const RemovalListener& removalListener = RemovalListener());
         ~ConcurrentCache();
         Value find(const Key& key);
+        // find which reports timeout by empty result instead of CacheTimeoutException, so callers expecting
+        // contention don't pay for exception unwinding; db errors are still thrown
+        boost::optional<Value> tryFind(const Key& key);
+        // hit resolves returned future right away, miss (or busy shard lock) is served by loader thread, so
+        // caller never waits for db; errors, timeouts included, are delivered through the future
+        std::future<Value> findAsync(const Key& key);
+        // under CacheOptions::WritePolicy::writeThrough update and updateMany return once values are in db
         void update(const Key& key, const Value& value);
+        // record expires timeToLive after this update regardless of CacheOptions expiry policy, hits extend it
+        // under expireAfterAccess as usual
+        void update(const Key& key, const Value& value, const std::chrono::milliseconds& timeToLive);
+        // values of keys in the same order; keys are grouped by shard, so every shard is locked once per call,
+        // and all misses are read from db in one pass
+        std::vector<Value> findMany(const std::vector<Key>& keys);
+        // records are applied in order, every shard is write locked once for all its records; on timeout records
+        // of shards handled before the timed out one stay updated
+        void updateMany(const std::vector<std::pair<Key, Value>>& records);
+        // drops record of the key, if it's cached, and deletes the key from db by Backend::remove; returns once
+        // backend has deleted it (and flushed under writeThrough policy), finds meanwhile don't see the key
+        void remove(const Key& key);
+        // count of records
         std::uint64_t size();
+        // total weight of records, never exceeds maxSize, unless a single record is heavier than a shard
+        std::uint64_t weight();
         std::uint64_t maxSize();
+        std::size_t shardsCount();
+        // find() calls served from cache and loaded from db (or known to be absent from it) since construction
+        CacheStats stats();
+        // wakes sync thread and waits till its pass started after this call completes, so everything updated
+        // before the call is in db; rethrows error which stopped sync thread. Called by removal listener on sync
+        // thread it can't wait for a pass and returns, records are written by the next pass
+        void flush();
         static const char* dbName(){
             return "db.json";
         }
+        static const char* logDbName(){
+            return "db.log";
+        }
+        static const char* mappedDbName(){
+            return "db.bin";
+        }
 
     private:
-        struct ValueRecord{
-                Value value;
-                std::shared_ptr<boost::timed_mutex> mtx; // wrap with pointer to make this struct copyble
+        // value is immutable snapshot, update publishes new one instead of modifying it in place, so find hit
+        // copies value without record lock. Snapshot replaced under shard read lock may still be read by
+        // concurrent find, it's retired to the shard and deleted when shard write lock is taken next time
+        struct ValueRecord : private boost::noncopyable {
+                std::atomic<const Value*> value;
+                RecordLock mtx; // serializes writers of the record
+                // value changed since last sync, guarded by mtx (or by shard write lock)
+                bool dirty;
+                // record is in shard expiry wheel, guarded by shard write lock
+                bool scheduled;
+                // Weigher result, guarded by mtx (or by shard write lock)
+                std::uint32_t weight;
+                // milliseconds since cache construction, 0 - never expires; stored under shard read lock by hits
+                std::atomic<std::uint64_t> expiresAt;
+                // tells this record from the one evicted before with the same key, when the wheel fires
+                std::uint64_t ticket;
                 ValueRecord(const Value& val)
-                    :value{val},
-                     mtx{std::make_shared<boost::timed_mutex>()}{}
+                    :value{new Value(val)},
+                     dirty{false},
+                     scheduled{false},
+                     weight{0},
+                     expiresAt{0},
+                     ticket{0}{}
+                // hashmap moves records doing rehash under shard write lock, no reader or record lock owner then
+                ValueRecord(ValueRecord&& other) noexcept
+                    :value{other.value.exchange(nullptr, std::memory_order_relaxed)},
+                     dirty{other.dirty},
+                     scheduled{other.scheduled},
+                     weight{other.weight},
+                     expiresAt{other.expiresAt.load(std::memory_order_relaxed)},
+                     ticket{other.ticket}{}
+                ~ValueRecord(){
+                    // record is erased under shard write lock, nobody reads the snapshot
+                    delete value.load(std::memory_order_relaxed);
+                }
+        };
+
 
+        // lifetime manager stores RecordHandle of records, handle doesn't invalidate when hashmap moves records
+        // doing rehash, while iterators and references does
+        typedef FlatHashMap<Key, ValueRecord, Hasher> RecordsMap;
 
+        struct ExpiryEntry{
+                Key key;
+                std::uint64_t ticket;
         };
 
+        // slot of shard table of keys db doesn't have
+        struct AbsentSlot{
+                bool used{false};
+                Key key;
+        };
+
+        // record removed from shard, waiting for write back and removal listener
+        // load of a key being read from db; update of the key made meanwhile supersedes it, since value read
+        // may be older than the update, which could even be written back and evicted before the load completes
+        struct PendingLoad{
+                std::shared_future<Value> result;
+                bool superseded;
+        };
+
+        struct RemovedRecord{
+                Key key;
+                // null if removed key wasn't cached
+                std::unique_ptr<const Value> value;
+                // db needs the value written or, for removed cause, the key deleted
+                bool dirty;
+                RemovalCause cause;
+        };
 
-        // use value_type reference to store records links in lifetime manager, value_type ref doesn't invalidate when
-        // hashmap reallocating and doing rehash, while iterators does
-        typedef typename std::reference_wrapper<typename std::unordered_map<Key, ValueRecord, Hasher>::value_type> RecordRef;
+        // independent slice of the cache guarded by its own mutex, key belongs to the shard selected by Hasher
+        struct Shard : private boost::noncopyable {
+                ReadMostlySharedMutex sharedMtx;
+                RecordsMap hashMap;
+                // keys being read from db right now, concurrent misses on such key wait for the single load.
+                // Misses register under shard read lock and pendingMtx, so they don't need write lock, everything
+                // else is done under write lock
+                std::unordered_map<Key, PendingLoad, Hasher> pendingLoads;
+                std::mutex pendingMtx;
+                // keys of records modified since last sync, updates append here under shard read lock without
+                // waiting for each other or for sync thread draining it; only the first modification of a record
+                // since its last write lists the key, so repeated updates are coalesced. Key of a record removed
+                // before sync is skipped, it was written back on removal
+                WriteBehindQueue<Key> dirtyKeys;
+                LifetimeManager<RecordHandle> recordLifetimeManager;
+                std::uint64_t maxWeight;
+                // eviction watermarks, see CacheOptions
+                std::uint64_t highWeight;
+                std::uint64_t lowWeight;
+                // trim task is queued to loaders and hasn't finished yet
+                std::atomic<bool> trimScheduled;
+                std::uint64_t currentSize;
+                // shrinking updates subtract from it under shard read lock, everything else is done under write lock
+                std::atomic<std::uint64_t> currentWeight;
+                // snapshots replaced under shard read lock, deleted under shard write lock
+                std::mutex retiredMtx;
+                std::vector<const Value*> retiredValues;
+                // counted under shard read lock by many threads, striped so hits don't share a cache line
+                StripedCounter hits;
+                StripedCounter misses;
+                // records with deadline, advanced by sync thread, ticks are milliseconds
+                TimingWheel<ExpiryEntry> expiryWheel;
+                std::uint64_t nextTicket;
+                // removed records are queued under shard write lock and handled after it's released by the same
+                // thread, see writeBackRemoved
+                std::vector<RemovedRecord> removedRecords;
+                std::atomic<bool> removedPending;
+                // unsynced values of removed records until they are written to db, loads take values from here,
+                // since db has outdated ones; values are owned by removed records, null value is a key being
+                // deleted from db, see writtenBackValue; guarded by shard write lock
+                std::unordered_map<Key, const Value*, Hasher> writingBack;
+                // serializes write backs of the shard, so values of the same key reach db in removal order
+                std::mutex writeBackMtx;
+                // keys passed presence filter, but not found in db, slot is picked by key hash and the latest key
+                // takes it; empty without presence filter, guarded like hashMap
+                std::vector<AbsentSlot> absentSlots;
+                Shard(std::uint64_t shardMaxWeight, std::uint64_t shardHighWeight, std::uint64_t shardLowWeight)
+                    :maxWeight{shardMaxWeight},
+                     highWeight{shardHighWeight},
+                     lowWeight{shardLowWeight},
+                     trimScheduled{false},
+                     currentSize{0},
+                     currentWeight{0},
+                     nextTicket{0},
+                     removedPending{false}{}
+                ~Shard(){
+                    for(auto retiredValue : retiredValues){
+                        delete retiredValue;
+                    }
+                }
+        };
 
         static const char* unexpectedException(){
             return "Unexpected exception";
         }
 
+        // timed out lookup gives empty value, throwing API turns it into exception
+        static Value valueOrThrow(boost::optional<Value>&& value){
+            if(!value){
+                throw CacheTimeoutException();
+            }
+            return std::move(*value);
+        }
+
+        // value of writingBack entry, key being deleted is absent one
+        static Value writtenBackValue(const Value* value){
+            return nullptr == value ? Value() : *value;
+        }
+
+        static std::size_t maxRetiredValues(){
+            return 1024;
+        }
+
+        // percent of weight, doesn't overflow for any weight
+        static std::uint64_t watermark(std::uint64_t weight, unsigned int percent){
+            return weight / 100 * percent + weight % 100 * percent / 100;
+        }
+
+        static std::size_t absentSlotsCount(){
+            return 1024;
+        }
+
+        static std::uint64_t minPresenceFilterCapacity(){
+            return 64 * 1024;
+        }
+
+        // dirty records copied by sync under single shard read lock
+        static std::size_t syncChunkSize(){
+            return 256;
+        }
+
+        static std::string dbNameFor(const DbOptions& options){
+            if(!options.path.empty()){
+                return options.path;
+            }
+            switch(options.format){
+                case DbOptions::Format::appendLog:
+                    return logDbName();
+                case DbOptions::Format::mappedHashTable:
+                    return mappedDbName();
+                default:
+                    return dbName();
+            }
+        }
+
+        // milliseconds since construction, the clock of record deadlines
+        std::uint64_t expiryNow();
+        // deadline of record written now according to expiry policy
+        std::uint64_t writeDeadline();
+        std::uint32_t weightOf(const Key& key, const Value& value);
+        // false if record has expired, otherwise extends its deadline under expireAfterAccess
+        bool renewOnAccess(ValueRecord& record);
+        std::uint64_t keyHash(const Key& key);
+        RecordHandle recordHandle(Shard& shard, typename RecordsMap::iterator keyFound);
+        std::size_t shardIndexFor(const Key& key);
+        // caller holds shard lock, true if presence filter or absent slots tell db has no such key
+        bool knownAbsent(Shard& shard, const Key& key);
+        // caller holds shard write lock and completes load of the key which wasn't superseded by update, otherwise
+        // key updated meanwhile would be taken for absent one
+        void rememberAbsent(Shard& shard, const Key& key);
+        // caller holds shard write lock, key is going to be in db
+        void forgetAbsent(Shard& shard, const Key& key);
+        Shard& shardFor(const Key& key);
+        // item indexes bucketed by shard index, keyOf(index) gives key of the item
+        template<typename KeyOf>
+        std::vector<std::vector<std::size_t>> groupByShard(std::size_t itemsCount, KeyOf keyOf);
         void sync();
         void syncTask();
-        ValueRecord& loadFromDb(const Key& key);
-        void removeRecords();
+        // caller holds syncMtx_, sync pass can't wait for the end of period
+        bool syncDue();
+        // under writeThrough policy waits for sync pass writing updates made so far, concurrent updaters wait
+        // for the same pass
+        void writeThrough();
+        // caller holds shard lock, either write lock or read lock under which no record of the key was found.
+        // Returns pending load of the key, or registers loadPromise and returns invalid future, then caller reads
+        // db itself
+        std::shared_future<Value> registerLoad(Shard& shard, const Key& key, std::promise<Value>& loadPromise);
+        // caller holds no shard lock, waits for pending load or reads db, inserts the record and resolves
+        // registered loadPromise; empty if pending load wasn't waited for in time
+        boost::optional<Value> completeLoad(Shard& shard, const Key& key, std::promise<Value>& loadPromise,
+                                            const std::shared_future<Value>& pendingLoad);
+        // caller's lookup under readLock found no record of the key, the lock is released on return
+        boost::optional<Value> loadFromDb(Shard& shard, const Key& key, boost::shared_lock<ReadMostlySharedMutex>& readLock);
+        // drops expired record of the key under write lock and loads it again, empty on timeout
+        boost::optional<Value> reloadExpired(Shard& shard, const Key& key);
+        // loads keys[index] into values[index] for every missed index, missed indexes are grouped by shard
+        void loadManyFromDb(const std::vector<Key>& keys, const std::vector<std::size_t>& missed,
+                            std::vector<Value>& values);
+        void storeValue(const Key& key, const Value& value, std::uint64_t expiresAt);
+        // caller holds shard write lock
+        void updateRecord(Shard& shard, const Key& key, const Value& value, std::uint64_t expiresAt);
+        // caller holds shard write lock and looked up keyFound under it (or under read lock upgraded since)
+        void applyUpdate(Shard& shard, typename RecordsMap::iterator keyFound, const Key& key, const Value& value,
+                         std::uint64_t expiresAt);
+        ValueRecord& insertRecord(Shard& shard, const Key& key, const Value& value, std::uint64_t expiresAt);
+        // caller holds shard write lock
+        void scheduleExpiry(Shard& shard, const Key& key, ValueRecord& record);
+        // caller holds shard write lock
+        void expireRecord(Shard& shard, typename RecordsMap::iterator keyFound);
+        // caller holds shard write lock, removes record from all shard structures
+        void dropRecord(Shard& shard, typename RecordsMap::iterator keyFound);
+        // fires records due in shard expiry wheel
+        void expireRecords(Shard& shard);
+        void markDirty(Shard& shard, const Key& key, ValueRecord& record);
+        // caller holds record lock and shard read lock
+        void publishValue(Shard& shard, ValueRecord& record, const Value& value);
+        // caller holds shard write lock
+        void replaceValue(Shard& shard, ValueRecord& record, const Value& value);
+        void reclaimRetired(Shard& shard);
+        void removeRecords(Shard& shard);
+        // caller holds shard write lock, takes value of record which is about to be erased, if it needs write back
+        // or removal listener
+        void queueRemoved(Shard& shard, typename RecordsMap::iterator keyFound, RemovalCause cause);
+        // caller holds no shard lock, writes unsynced values of queued removed records to db in one batch, deletes
+        // keys passed to remove, and passes removed records to listener
+        void writeBackRemoved(Shard& shard);
+        // queues trimShard to loaders unless it's queued already
+        void scheduleTrim(Shard& shard);
+        // evicts records of shard down to its low watermark
+        void trimShard(Shard& shard);
 
 
         std::uint64_t maxSize_;
-        std::uint64_t currentSize_;
         std::chrono::milliseconds syncPeriodMs_;
         boost::chrono::microseconds getAccessTimeoutUs_;
+        std::chrono::milliseconds expireAfterWrite_;
+        std::chrono::milliseconds expireAfterAccess_;
+        std::chrono::steady_clock::time_point startPoint_;
 
         std::future<void> syncThreadRes_;
-        std::atomic<bool> stopSync_;
-        boost::shared_mutex globalSharedMtx_;
+        // sync thread sleeps on syncCondition_ till its period passes or it's woken by stop, flush request or
+        // dirty records count reaching syncDirtyThreshold_; flush callers wait on it for the pass to complete.
+        // Fields below are guarded by syncMtx_, except dirtyCount_
+        std::mutex syncMtx_;
+        std::condition_variable syncCondition_;
+        bool stopSync_;
+        std::uint64_t flushesRequested_;
+        std::uint64_t flushesDone_;
+        std::thread::id syncThreadId_;
+        std::exception_ptr syncError_;
+        std::uint64_t syncDirtyThreshold_;
+        std::chrono::milliseconds writeBehindDelay_;
+        CacheOptions::WritePolicy writePolicy_;
+        // records turned dirty since the last pass started, counted if either of options above is set
+        std::atomic<std::uint64_t> dirtyCount_;
 
-        std::unordered_map<Key, ValueRecord, Hasher> hashMap_;
-        CacheRecordLifetimeManager<RecordRef> recordLifetimeManager_;
-        SimpleDB<Key, Value> db_;
+        Hasher hasher_;
+        Weigher weigher_;
+        RemovalListener removalListener_;
+        // null if CacheOptions::presenceFilterBitsPerKey is zero
+        std::unique_ptr<PresenceFilter> presenceFilter_;
+        std::vector<std::unique_ptr<Shard>> shards_;
+        // backend isn't required to be thread safe, while loads from different shards may run in parallel
+        std::mutex dbMtx_;
+        Backend db_;
+        // the last member, so it is destroyed (finishing queued loads) while shards and db are still alive
+        TaskPool loaders_;
 
 };
 
 
-template<typename Key, typename Value, typename Hasher>
-ConcurrentCache<Key, Value, Hasher>::ConcurrentCache(std::uint64_t maxSize,
-                                                     const std::chrono::milliseconds& syncPeriodMs,
-                                                     const boost::chrono::microseconds& getAccessTimeoutUs)
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::ConcurrentCache(std::uint64_t maxSize,
+                                                                                        const std::chrono::milliseconds& syncPeriodMs,
+                                                                                        const boost::chrono::microseconds& getAccessTimeoutUs,
+                                                                                        const CacheOptions& options,
+                                                                                        const RemovalListener& removalListener)
     :maxSize_{maxSize},
-     currentSize_{0},
      syncPeriodMs_{syncPeriodMs},
      getAccessTimeoutUs_{getAccessTimeoutUs},
+     expireAfterWrite_{options.expireAfterWrite},
+     expireAfterAccess_{options.expireAfterAccess},
+     startPoint_{std::chrono::steady_clock::now()},
      stopSync_{false},
-     db_{this->dbName()} {
+     flushesRequested_{0},
+     flushesDone_{0},
+     syncDirtyThreshold_{options.syncDirtyThreshold},
+     writeBehindDelay_{options.writeBehindDelay},
+     writePolicy_{options.writePolicy},
+     dirtyCount_{0},
+     removalListener_{removalListener},
+     db_{dbNameFor(options.db), options.db},
+     loaders_{options.loaderThreadsCount} {
     if(0 == maxSize_){
         throw CacheInvalidArgument("Zero max cache size");
     }
+    if(0 == options.shardsCount){
+        throw CacheInvalidArgument("Zero shards count");
+    }
+    if(options.shardsCount > maxSize_){
+        throw CacheInvalidArgument("Shards count exceeds max cache size");
+    }
+    if(0 == options.loaderThreadsCount){
+        throw CacheInvalidArgument("Zero loader threads count");
+    }
+    if(expireAfterWrite_.count() < 0 || expireAfterAccess_.count() < 0){
+        throw CacheInvalidArgument("Negative expiry period");
+    }
+    if(writeBehindDelay_.count() < 0){
+        throw CacheInvalidArgument("Negative write behind delay");
+    }
+    if(0 != expireAfterWrite_.count() && 0 != expireAfterAccess_.count()){
+        throw CacheInvalidArgument("Both expireAfterWrite and expireAfterAccess set");
+    }
+    if(0 == options.evictionLowWatermarkPercent || options.evictionHighWatermarkPercent > 100){
+        throw CacheInvalidArgument("Eviction watermark out of range");
+    }
+    if(options.evictionLowWatermarkPercent > options.evictionHighWatermarkPercent){
+        throw CacheInvalidArgument("Low eviction watermark exceeds high one");
+    }
+
+    // split capacity between shards, first shards take the remainder, so total capacity is exactly maxSize
+    shards_.reserve(options.shardsCount);
+    for(std::size_t shardIndex = 0; shardIndex < options.shardsCount; ++shardIndex){
+        std::uint64_t shardMaxSize = maxSize_ / options.shardsCount + (shardIndex < maxSize_ % options.shardsCount ? 1 : 0);
+        shards_.emplace_back(new Shard{shardMaxSize,
+                                       watermark(shardMaxSize, options.evictionHighWatermarkPercent),
+                                       watermark(shardMaxSize, options.evictionLowWatermarkPercent)});
+    }
+
+    if(0 != options.presenceFilterBitsPerKey){
+        presenceFilter_.reset(new PresenceFilter{std::max(2 * db_.size(), minPresenceFilterCapacity()),
+                                                 options.presenceFilterBitsPerKey});
+        db_.forEachKey([this](const Key& key){
+            presenceFilter_->add(this->keyHash(key));
+        });
+        for(auto& shard : shards_){
+            shard->absentSlots.resize(absentSlotsCount());
+        }
+    }
 
     syncThreadRes_ = std::async(&ConcurrentCache::syncTask, this);
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-ConcurrentCache<Key, Value, Hasher>::~ConcurrentCache() {
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::~ConcurrentCache() {
     try{
         // get exceptions occured in sync thread
         try{
-            stopSync_.store(true);
+            {
+                std::lock_guard<std::mutex> syncLock{syncMtx_};
+                stopSync_ = true;
+            }
+            // sync thread makes the last pass right away, not after its period
+            syncCondition_.notify_all();
             syncThreadRes_.get();
         } catch (const std::exception& ex){
             std::cerr << ex.what(); // log somewhere
@@ -122,145 +533,1229 @@ ConcurrentCache<Key, Value, Hasher>::~ConcurrentCache() {
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-Value ConcurrentCache<Key, Value, Hasher>::find(const Key& key) {
-    boost::shared_lock<boost::shared_mutex> readLock{globalSharedMtx_, getAccessTimeoutUs_};
-    checkLock(readLock);
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+Value ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::find(const Key& key) {
+    return valueOrThrow(this->tryFind(key));
+}
 
-    auto keyFound = hashMap_.find(key);
-    if(hashMap_.end() == keyFound){
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+boost::optional<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::tryFind(const Key& key) {
+    auto& shard = this->shardFor(key);
+    boost::shared_lock<ReadMostlySharedMutex> readLock{shard.sharedMtx, getAccessTimeoutUs_};
+    if(!readLock.owns_lock()){
+        return boost::none;
+    }
+
+    auto keyFound = shard.hashMap.find(key);
+    if(shard.hashMap.end() != keyFound && this->renewOnAccess((*keyFound).second)){
+        shard.hits.increment();
+        shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+        // snapshot isn't deleted while shard read lock is held
+        return *(*keyFound).second.value.load(std::memory_order_acquire);
+    }
+    shard.misses.increment();
+    if(this->knownAbsent(shard, key)){
+        return Value();
+    }
+    if(shard.hashMap.end() != keyFound){
         readLock.unlock();
-        boost::unique_lock<boost::shared_mutex> globalWriteLock{globalSharedMtx_, getAccessTimeoutUs_};
-        checkLock(globalWriteLock);
-        // another thread could load such key since this thread unlocked shared mutex, need to check it
-        auto keyFound = hashMap_.find(key);
-        if(hashMap_.end() == keyFound){
-            return (this->loadFromDb(key)).value;
-        } else {
-            return (*keyFound).second.value;
+        return this->reloadExpired(shard, key);
+    }
+    // the miss is registered under the same read lock, no second lookup under write lock
+    return this->loadFromDb(shard, key, readLock);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::future<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::findAsync(const Key& key) {
+    auto& shard = this->shardFor(key);
+    auto findPromise = std::make_shared<std::promise<Value>>();
+    auto findFuture = findPromise->get_future();
+
+    auto resolveByLoader = [this, findPromise](std::function<boost::optional<Value>()> load){
+        loaders_.submit([findPromise, load](){
+            try{
+                findPromise->set_value(valueOrThrow(load()));
+            } catch(...){
+                findPromise->set_exception(std::current_exception());
+            }
+        });
+    };
+
+    boost::shared_lock<ReadMostlySharedMutex> readLock{shard.sharedMtx, boost::try_to_lock};
+    if(!readLock.owns_lock()){
+        // shard locked by writer is waited for by loader thread with usual timeout
+        resolveByLoader([this, key](){
+            return this->tryFind(key);
+        });
+        return findFuture;
+    }
+    auto keyFound = shard.hashMap.find(key);
+    if(shard.hashMap.end() != keyFound && this->renewOnAccess((*keyFound).second)){
+        shard.hits.increment();
+        shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+        // snapshot isn't deleted while shard read lock is held
+        findPromise->set_value(*(*keyFound).second.value.load(std::memory_order_acquire));
+        return findFuture;
+    }
+    shard.misses.increment();
+    if(this->knownAbsent(shard, key)){
+        findPromise->set_value(Value());
+        return findFuture;
+    }
+    if(shard.hashMap.end() != keyFound){
+        readLock.unlock();
+        resolveByLoader([this, &shard, key](){
+            return this->reloadExpired(shard, key);
+        });
+        return findFuture;
+    }
+    auto removedFound = shard.writingBack.find(key);
+    if(shard.writingBack.end() != removedFound){
+        findPromise->set_value(writtenBackValue((*removedFound).second));
+        return findFuture;
+    }
+
+    // load is registered right away, so it's coalesced with concurrent misses of the key, loader thread reads it
+    auto loadPromise = std::make_shared<std::promise<Value>>();
+    auto pendingLoad = this->registerLoad(shard, key, *loadPromise);
+    readLock.unlock();
+    auto completeLoad = [this, &shard, key, loadPromise, pendingLoad](){
+        return this->completeLoad(shard, key, *loadPromise, pendingLoad);
+    };
+    try{
+        resolveByLoader(completeLoad);
+    } catch(...){
+        // registered load must be resolved in any case, caller loads it itself then
+        try{
+            findPromise->set_value(valueOrThrow(completeLoad()));
+        } catch(...){
+            findPromise->set_exception(std::current_exception());
         }
+    }
+    return findFuture;
+}
 
-    } else {
-        boost::unique_lock<boost::timed_mutex> recordLock{*((*keyFound).second.mtx), getAccessTimeoutUs_};
-        checkLock(recordLock);
-        return (*keyFound).second.value;
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::update(const Key& key, const Value& value) {
+    this->storeValue(key, value, this->writeDeadline());
+    this->writeThrough();
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::update(const Key& key, const Value& value,
+                                                                                    const std::chrono::milliseconds& timeToLive) {
+    if(timeToLive.count() <= 0){
+        throw CacheInvalidArgument("Non-positive time to live");
     }
+    this->storeValue(key, value, this->expiryNow() + static_cast<std::uint64_t>(timeToLive.count()));
+    this->writeThrough();
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-void ConcurrentCache<Key, Value, Hasher>::update(const Key& key, const Value& value) {
-    boost::shared_lock<boost::shared_mutex> readLock{globalSharedMtx_, getAccessTimeoutUs_};
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::storeValue(const Key& key, const Value& value,
+                                                                                        std::uint64_t expiresAt) {
+    auto& shard = this->shardFor(key);
+    boost::shared_lock<ReadMostlySharedMutex> readLock{shard.sharedMtx, getAccessTimeoutUs_};
     checkLock(readLock);
 
-    auto keyFound = hashMap_.find(key);
-    if(hashMap_.end() == keyFound){
+    auto keyFound = shard.hashMap.find(key);
+    // record getting its first deadline is put to expiry wheel, that needs write lock
+    if(shard.hashMap.end() != keyFound && (0 == expiresAt || (*keyFound).second.scheduled)){
+        auto& record = (*keyFound).second;
+        shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+        boost::unique_lock<RecordLock> recordLock{record.mtx, getAccessTimeoutUs_};
+        checkLock(recordLock);
+        auto weight = this->weightOf(key, value);
+        // grown record may need evictions, which need write lock
+        if(weight <= record.weight){
+            this->publishValue(shard, record, value);
+            shard.currentWeight.fetch_sub(record.weight - weight, std::memory_order_relaxed);
+            record.weight = weight;
+            record.expiresAt.store(expiresAt, std::memory_order_relaxed);
+            this->markDirty(shard, key, record);
+            recordLock.unlock();
+            readLock.unlock();
+
+            // shard may see no misses for long, so writer frees snapshots itself once too many of them pile up
+            bool reclaimNeeded{false};
+            {
+                std::lock_guard<std::mutex> retiredLock{shard.retiredMtx};
+                reclaimNeeded = shard.retiredValues.size() >= maxRetiredValues();
+            }
+            if(reclaimNeeded){
+                boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+                if(shardWriteLock.owns_lock()){
+                    this->reclaimRetired(shard);
+                }
+            }
+            return;
+        }
+    }
+
+    if(shard.sharedMtx.try_unlock_shared_and_lock_for(getAccessTimeoutUs_)){
+        // no writer got in while upgrading, the lookup still holds
+        readLock.release();
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, boost::adopt_lock};
+        this->reclaimRetired(shard);
+        this->applyUpdate(shard, keyFound, key, value, expiresAt);
+    } else {
+        // another writer is in, shard is locked anew
         readLock.unlock();
-        boost::unique_lock<boost::shared_mutex> globalWriteLock{globalSharedMtx_, getAccessTimeoutUs_};
-        checkLock(globalWriteLock);
-        // another thread could load such key since this thread unlocked shared mutex, need to check it
-        auto keyFound = hashMap_.find(key);
-        if(hashMap_.end() == keyFound){
-            this->loadFromDb(key).value = value;
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+        checkLock(shardWriteLock);
+        this->reclaimRetired(shard);
+        // another thread could load such key since this thread unlocked shared mutex, updateRecord checks it
+        this->updateRecord(shard, key, value, expiresAt);
+    }
+    this->writeBackRemoved(shard);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::vector<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::findMany(const std::vector<Key>& keys) {
+    std::vector<Value> values(keys.size());
+    auto indexesByShard = this->groupByShard(keys.size(), [&keys](std::size_t index) -> const Key& {
+        return keys[index];
+    });
+
+    std::vector<std::size_t> missed;
+    for(std::size_t shardIndex = 0; shardIndex < shards_.size(); ++shardIndex){
+        const auto& indexes = indexesByShard[shardIndex];
+        if(indexes.empty()){
+            continue;
+        }
+        auto& shard = *shards_[shardIndex];
+        boost::shared_lock<ReadMostlySharedMutex> readLock{shard.sharedMtx, getAccessTimeoutUs_};
+        checkLock(readLock);
+        for(auto index : indexes){
+            shard.hashMap.prefetch(keys[index]);
+        }
+        for(auto index : indexes){
+            auto keyFound = shard.hashMap.find(keys[index]);
+            if(shard.hashMap.end() == keyFound || !this->renewOnAccess((*keyFound).second)){
+                shard.misses.increment();
+                if(!this->knownAbsent(shard, keys[index])){
+                    missed.push_back(index);
+                }
+            } else {
+                shard.hits.increment();
+                shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+                // snapshot isn't deleted while shard read lock is held
+                values[index] = *(*keyFound).second.value.load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    if(!missed.empty()){
+        this->loadManyFromDb(keys, missed, values);
+    }
+    return values;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::updateMany(const std::vector<std::pair<Key, Value>>& records) {
+    auto indexesByShard = this->groupByShard(records.size(), [&records](std::size_t index) -> const Key& {
+        return records[index].first;
+    });
+    auto expiresAt = this->writeDeadline();
+
+    for(std::size_t shardIndex = 0; shardIndex < shards_.size(); ++shardIndex){
+        const auto& indexes = indexesByShard[shardIndex];
+        if(indexes.empty()){
+            continue;
+        }
+        auto& shard = *shards_[shardIndex];
+        {
+            // write lock replaces snapshots in place, so the batch neither takes record locks nor retires values
+            boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+            checkLock(shardWriteLock);
+            this->reclaimRetired(shard);
+            for(auto index : indexes){
+                shard.hashMap.prefetch(records[index].first);
+            }
+            for(auto index : indexes){
+                this->updateRecord(shard, records[index].first, records[index].second, expiresAt);
+            }
+        }
+        this->writeBackRemoved(shard);
+    }
+    // the whole batch is committed at once
+    this->writeThrough();
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::remove(const Key& key) {
+    auto& shard = this->shardFor(key);
+    {
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+        checkLock(shardWriteLock);
+        this->reclaimRetired(shard);
+        // pending load of the key mustn't cache the value it read, it finds the key being deleted instead
+        auto loadFound = shard.pendingLoads.find(key);
+        if(shard.pendingLoads.end() != loadFound){
+            (*loadFound).second.superseded = true;
+        }
+        auto keyFound = shard.hashMap.find(key);
+        if(shard.hashMap.end() != keyFound){
+            this->queueRemoved(shard, keyFound, RemovalCause::removed);
+            this->dropRecord(shard, keyFound);
         } else {
-            (*keyFound).second.value = value;
+            // db may still have the key, it's deleted the same way, there is just no value for listener
+            shard.removedRecords.push_back(RemovedRecord{key, nullptr, true, RemovalCause::removed});
+            try{
+                shard.writingBack[key] = nullptr;
+            } catch(...){
+                shard.removedRecords.pop_back();
+                throw;
+            }
+            shard.removedPending.store(true, std::memory_order_release);
         }
+    }
+    // removals of the shard queued before are written ahead of this one
+    this->writeBackRemoved(shard);
+    this->writeThrough();
+}
 
-    } else {
-        boost::unique_lock<boost::timed_mutex> recordLock{*((*keyFound).second.mtx), getAccessTimeoutUs_};
-        checkLock(recordLock);
-        (*keyFound).second.value = value;
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::size() {
+    std::uint64_t totalSize{0};
+    for(auto& shard : shards_){
+        boost::shared_lock<ReadMostlySharedMutex> shardReadLock{shard->sharedMtx, getAccessTimeoutUs_};
+        checkLock(shardReadLock);
+        totalSize += shard->currentSize;
     }
+    return totalSize;
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-std::uint64_t ConcurrentCache<Key, Value, Hasher>::size() {
-    boost::shared_lock<boost::shared_mutex> globalReadLock{globalSharedMtx_, getAccessTimeoutUs_};
-    checkLock(globalReadLock);
-    return currentSize_;
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::weight() {
+    std::uint64_t totalWeight{0};
+    for(auto& shard : shards_){
+        totalWeight += shard->currentWeight.load(std::memory_order_relaxed);
+    }
+    return totalWeight;
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-std::uint64_t ConcurrentCache<Key, Value, Hasher>::maxSize() {
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::maxSize() {
     return maxSize_; // readonly value, no need sync
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-void ConcurrentCache<Key, Value, Hasher>::sync() {
-    std::for_each(std::begin(hashMap_), std::end(hashMap_), [this](auto& thisRecord){
-        boost::unique_lock<boost::timed_mutex> recordLock{*((thisRecord).second.mtx)};
-        db_.update(thisRecord.first, thisRecord.second.value);
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::size_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::shardsCount() {
+    return shards_.size(); // readonly value, no need sync
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+CacheStats ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::stats() {
+    CacheStats totalStats;
+    for(auto& shard : shards_){
+        totalStats.hits += shard->hits.load();
+        totalStats.misses += shard->misses.load();
+    }
+    return totalStats;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::expiryNow() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startPoint_).count());
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::writeDeadline() {
+    // loads and updates start expireAfterAccess period too
+    auto period = 0 != expireAfterWrite_.count() ? expireAfterWrite_ : expireAfterAccess_;
+    return 0 == period.count() ? 0 : this->expiryNow() + static_cast<std::uint64_t>(period.count());
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint32_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::weightOf(const Key& key, const Value& value) {
+    // record heavier than 4GB weighs as 4GB, it takes a whole shard anyway
+    return static_cast<std::uint32_t>(std::min<std::uint64_t>(weigher_(key, value), std::numeric_limits<std::uint32_t>::max()));
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+bool ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::renewOnAccess(ValueRecord& record) {
+    auto expiresAt = record.expiresAt.load(std::memory_order_relaxed);
+    if(0 == expiresAt){
+        return true;
+    }
+    auto now = this->expiryNow();
+    if(expiresAt <= now){
+        return false;
+    }
+    // concurrent hits may store slightly different deadlines, any of them is fine
+    if(0 != expireAfterAccess_.count() && now + static_cast<std::uint64_t>(expireAfterAccess_.count()) > expiresAt){
+        record.expiresAt.store(now + static_cast<std::uint64_t>(expireAfterAccess_.count()), std::memory_order_relaxed);
+    }
+    return true;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::uint64_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::keyHash(const Key& key) {
+    return static_cast<std::uint64_t>(hasher_(key)) * 0x9E3779B97F4A7C15ull;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+RecordHandle ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::recordHandle(Shard& shard,
+                                                                                                  typename RecordsMap::iterator keyFound) {
+    return RecordHandle{shard.hashMap.handle(keyFound), static_cast<std::uint32_t>(this->keyHash((*keyFound).first))};
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::size_t ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::shardIndexFor(const Key& key) {
+    // shard hashmaps use the same Hasher, so mix hash bits before taking modulo, otherwise every key of a shard
+    // would share the same remainder and cluster in the shard's buckets
+    return (this->keyHash(key) >> 32) % shards_.size();
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+bool ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::knownAbsent(Shard& shard, const Key& key) {
+    if(!presenceFilter_){
+        return false;
+    }
+    auto hash = this->keyHash(key);
+    if(!presenceFilter_->mayContain(hash)){
+        return true;
+    }
+    const auto& slot = shard.absentSlots[hash % shard.absentSlots.size()];
+    return slot.used && slot.key == key;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::rememberAbsent(Shard& shard, const Key& key) {
+    auto& slot = shard.absentSlots[this->keyHash(key) % shard.absentSlots.size()];
+    slot.key = key;
+    slot.used = true;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::forgetAbsent(Shard& shard, const Key& key) {
+    if(!presenceFilter_){
+        return;
+    }
+    // filter gets the key before record is inserted, so lookups which don't find the record see it in filter
+    auto hash = this->keyHash(key);
+    presenceFilter_->add(hash);
+    auto& slot = shard.absentSlots[hash % shard.absentSlots.size()];
+    if(slot.used && slot.key == key){
+        slot.used = false;
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+typename ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::Shard&
+ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::shardFor(const Key& key) {
+    return *shards_[shardIndexFor(key)];
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+template<typename KeyOf>
+std::vector<std::vector<std::size_t>>
+ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::groupByShard(std::size_t itemsCount, KeyOf keyOf) {
+    std::vector<std::vector<std::size_t>> indexesByShard(shards_.size());
+    for(std::size_t index = 0; index < itemsCount; ++index){
+        indexesByShard[shardIndexFor(keyOf(index))].push_back(index);
+    }
+    return indexesByShard;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::sync() {
+    // this method shouldn't be called from multiple threads (syncronization thread only)
+    std::vector<Key> dirtyKeys;
+    std::vector<std::pair<Key, Value>> chunk;
+    for(auto& shard : shards_){
+        shard->dirtyKeys.takeAll(dirtyKeys);
+
+        // shard is read locked just to copy a chunk of values, so writers of the shard wait for one chunk at most,
+        // not for the whole flush and db writes. Db lock is held from the copy till the chunk is written, so
+        // loads of its keys and write backs of their newer values don't overtake it
+        for(std::size_t chunkBegin = 0; chunkBegin < dirtyKeys.size(); chunkBegin += syncChunkSize()){
+            auto chunkEnd = std::min(dirtyKeys.size(), chunkBegin + syncChunkSize());
+            std::lock_guard<std::mutex> dbLock{dbMtx_};
+            {
+                boost::shared_lock<ReadMostlySharedMutex> shardReadLock{shard->sharedMtx};
+                for(auto keyIndex = chunkBegin; keyIndex < chunkEnd; ++keyIndex){
+                    auto keyFound = shard->hashMap.find(dirtyKeys[keyIndex]);
+                    if(shard->hashMap.end() == keyFound){
+                        continue; // removed and written back since marked dirty
+                    }
+                    boost::unique_lock<RecordLock> recordLock{(*keyFound).second.mtx};
+                    // key may be listed twice if record was evicted and inserted again, flush it once
+                    if((*keyFound).second.dirty){
+                        // clear flag under record lock, so update made after this point lists the key again
+                        (*keyFound).second.dirty = false;
+                        chunk.emplace_back((*keyFound).first, *(*keyFound).second.value.load(std::memory_order_relaxed));
+                    }
+                }
+            }
+            db_.updateMany(chunk);
+            chunk.clear();
+        }
+        dirtyKeys.clear();
+    }
+
+    for(auto& shard : shards_){
+        this->expireRecords(*shard);
+        // also retries write backs failed before
+        this->writeBackRemoved(*shard);
+        // write back another thread has in flight is waited for, so flush covers records removed before it
+        std::lock_guard<std::mutex> writeBackLock{shard->writeBackMtx};
+    }
+
+    // write the batch collected by this pass at once
+    std::lock_guard<std::mutex> dbLock{dbMtx_};
+    db_.flush();
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::syncTask() {
+    std::unique_lock<std::mutex> syncLock{syncMtx_};
+    syncThreadId_ = std::this_thread::get_id();
+    auto nextSync = std::chrono::steady_clock::now() + syncPeriodMs_;
+    try{
+        while(1) {
+            syncCondition_.wait_until(syncLock, nextSync, [this](){
+                return this->syncDue() || (0 != writeBehindDelay_.count() && 0 != dirtyCount_.load(std::memory_order_relaxed));
+            });
+            if(!this->syncDue() && 0 != dirtyCount_.load(std::memory_order_relaxed)){
+                // write behind: the first dirty record opens a batch, updates made within the delay are written
+                // by the same pass
+                auto batchEnd = std::min(nextSync, std::chrono::steady_clock::now() + writeBehindDelay_);
+                syncCondition_.wait_until(syncLock, batchEnd, [this](){
+                    return this->syncDue();
+                });
+            }
+            bool stopping{stopSync_};
+            auto flushesServed = flushesRequested_;
+            syncLock.unlock();
+
+            nextSync = std::chrono::steady_clock::now() + syncPeriodMs_;
+            dirtyCount_.store(0, std::memory_order_relaxed);
+            this->sync();
+
+            syncLock.lock();
+            flushesDone_ = flushesServed;
+            syncCondition_.notify_all();
+            if(stopping) {
+                break;
+            }
+        }
+    } catch(...){
+        if(!syncLock.owns_lock()){
+            syncLock.lock();
+        }
+        syncError_ = std::current_exception();
+        syncCondition_.notify_all();
+        throw;
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+bool ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::syncDue() {
+    return stopSync_ || flushesRequested_ != flushesDone_ ||
+           (0 != syncDirtyThreshold_ && dirtyCount_.load(std::memory_order_relaxed) >= syncDirtyThreshold_);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::writeThrough() {
+    // dirty records are written by the next pass along with updates of concurrent writers, so db sees one batch
+    // and one fsync for all of them, and write order of the key stays the one of sync and write backs
+    if(CacheOptions::WritePolicy::writeThrough == writePolicy_){
+        this->flush();
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::flush() {
+    std::unique_lock<std::mutex> syncLock{syncMtx_};
+    if(std::this_thread::get_id() == syncThreadId_){
+        return; // removal listener called by sync pass, it would wait for itself
+    }
+    // pass already running may have missed updates made before this call, the next one is waited for
+    auto flushTicket = ++flushesRequested_;
+    syncCondition_.notify_all();
+    syncCondition_.wait(syncLock, [this, flushTicket](){
+        return flushesDone_ >= flushTicket || syncError_;
     });
+    if(flushesDone_ < flushTicket){
+        std::rethrow_exception(syncError_);
+    }
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-void ConcurrentCache<Key, Value, Hasher>::syncTask() {
-    auto startPoint = std::chrono::system_clock::now();
-    auto endPoint = startPoint;
-    while(1) {
-        if(std::chrono::duration_cast<std::chrono::milliseconds>(endPoint - startPoint) < syncPeriodMs_){
-            auto waitForMs = syncPeriodMs_- std::chrono::duration_cast<std::chrono::milliseconds>(endPoint - startPoint);
-            std::this_thread::sleep_for(waitForMs);
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+boost::optional<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::loadFromDb(Shard& shard, const Key& key,
+                                                                                                          boost::shared_lock<ReadMostlySharedMutex>& readLock) {
+    // value of removed record isn't in db yet, it's returned without caching until write back completes
+    auto removedFound = shard.writingBack.find(key);
+    if(shard.writingBack.end() != removedFound){
+        return writtenBackValue((*removedFound).second);
+    }
+    std::promise<Value> loadPromise;
+    auto pendingLoad = this->registerLoad(shard, key, loadPromise);
+    readLock.unlock();
+    return this->completeLoad(shard, key, loadPromise, pendingLoad);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+boost::optional<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::reloadExpired(Shard& shard, const Key& key) {
+    std::promise<Value> loadPromise;
+    std::shared_future<Value> pendingLoad;
+    boost::optional<Value> removedValue;
+    {
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+        if(!shardWriteLock.owns_lock()){
+            return boost::none;
+        }
+        this->reclaimRetired(shard);
+        // another thread could reload such key since this thread unlocked shared mutex, need to check it
+        auto keyFound = shard.hashMap.find(key);
+        if(shard.hashMap.end() != keyFound){
+            if(this->renewOnAccess((*keyFound).second)){
+                shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+                return *(*keyFound).second.value.load(std::memory_order_relaxed);
+            }
+            this->expireRecord(shard, keyFound);
         }
+        auto removedFound = shard.writingBack.find(key);
+        if(shard.writingBack.end() != removedFound){
+            removedValue = writtenBackValue((*removedFound).second);
+        } else {
+            pendingLoad = this->registerLoad(shard, key, loadPromise);
+        }
+    }
+    // unsynced value of expired record
+    this->writeBackRemoved(shard);
+    if(removedValue){
+        return removedValue;
+    }
+    return this->completeLoad(shard, key, loadPromise, pendingLoad);
+}
+
 
-        startPoint = std::chrono::system_clock::now();
-        boost::shared_lock<boost::shared_mutex> globalReadLock{globalSharedMtx_};
-        // here, internally we access db under reader lock only, this method shouldn't be called from multiple threads
-        // (syncronization thread only)
-        this->sync();
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+std::shared_future<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::registerLoad(Shard& shard, const Key& key,
+                                                                                                               std::promise<Value>& loadPromise) {
+    // shard lock keeps writers, so insertions of the key as well, out
+    std::lock_guard<std::mutex> pendingLock{shard.pendingMtx};
+    auto loadFound = shard.pendingLoads.find(key);
+    if(shard.pendingLoads.end() != loadFound){
+        return (*loadFound).second.result;
+    }
+    shard.pendingLoads.emplace(key, PendingLoad{loadPromise.get_future().share(), false});
+    return std::shared_future<Value>();
+}
 
-        if(stopSync_.load()) {
-            break;
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+boost::optional<Value> ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::completeLoad(Shard& shard, const Key& key,
+                                                                                                            std::promise<Value>& loadPromise,
+                                                                                                            const std::shared_future<Value>& pendingLoad) {
+    if(pendingLoad.valid()){
+        // somebody is already reading this key from db, wait for its result instead of reading it once more
+        if(std::future_status::ready != pendingLoad.wait_for(std::chrono::microseconds{getAccessTimeoutUs_.count()})){
+            return boost::none;
+        }
+        return pendingLoad.get();
+    }
+
+    Value value{};
+    std::exception_ptr loadError;
+    while(1){
+        // db read is done without shard lock, so readers of other keys aren't blocked by slow storage
+        bool inDb{false};
+        try{
+            std::lock_guard<std::mutex> dbLock{dbMtx_};
+            value = Value();
+            inDb = db_.find(key, value);
+        } catch(...){
+            loadError = std::current_exception();
         }
-        endPoint = std::chrono::system_clock::now();
+
+        // no timeout here, pending load must be resolved in any case, otherwise waiters would hang on it
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx};
+        this->reclaimRetired(shard);
+        auto loadFound = shard.pendingLoads.find(key);
+        if(!loadError && (*loadFound).second.superseded){
+            // key was updated while loading, db value is outdated; the update is in the cache or in db by now
+            auto keyFound = shard.hashMap.find(key);
+            auto removedFound = shard.writingBack.find(key);
+            if(shard.hashMap.end() != keyFound){
+                value = *(*keyFound).second.value.load(std::memory_order_relaxed);
+            } else if(shard.writingBack.end() != removedFound){
+                value = writtenBackValue((*removedFound).second);
+            } else {
+                // written back and evicted, read again
+                (*loadFound).second.superseded = false;
+                continue;
+            }
+        } else if(!loadError){
+            // key isn't cached nor written back, when its load is registered, and only an update could bring it
+            // to the cache, so db value is the current one
+            try{
+                // absent key doesn't take room of records, when presence filter is used
+                if(!inDb && presenceFilter_){
+                    this->rememberAbsent(shard, key);
+                } else {
+                    this->insertRecord(shard, key, value, this->writeDeadline());
+                }
+            } catch(...){
+                loadError = std::current_exception();
+            }
+        }
+        shard.pendingLoads.erase(loadFound);
+        break;
+    }
+
+    if(loadError){
+        loadPromise.set_exception(loadError);
+    } else {
+        loadPromise.set_value(value);
     }
+    // records evicted to make room for the loaded one
+    this->writeBackRemoved(shard);
+    if(loadError){
+        std::rethrow_exception(loadError);
+    }
+    return value;
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-typename ConcurrentCache<Key, Value, Hasher>::ValueRecord& ConcurrentCache<Key, Value, Hasher>::loadFromDb(const Key& key) {
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::loadManyFromDb(const std::vector<Key>& keys,
+                                                                                            const std::vector<std::size_t>& missed,
+                                                                                            std::vector<Value>& values) {
+    // keys this call reads itself, registered in pendingLoads as loadFromDb does
+    struct OwnLoad{
+            std::size_t index;
+            Shard* shard;
+            std::promise<Value> promise;
+            std::exception_ptr error;
+            bool inDb;
+    };
+    std::vector<OwnLoad> ownLoads;
+    ownLoads.reserve(missed.size());
+    // keys somebody else is reading already (this call too, if the key is listed twice)
+    std::vector<std::pair<std::size_t, std::shared_future<Value>>> awaitedLoads;
+
+    // loads registered before a shard lock timed out are still read and resolved, otherwise waiters would hang
+    std::exception_ptr lockError;
+    try{
+        std::size_t position{0};
+        while(position < missed.size()){
+            auto& shard = this->shardFor(keys[missed[position]]);
+            boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+            checkLock(shardWriteLock);
+            this->reclaimRetired(shard);
+            for(; position < missed.size() && &shard == &this->shardFor(keys[missed[position]]); ++position){
+                auto index = missed[position];
+                // another thread could load such key since this thread unlocked shared mutex, need to check it
+                auto keyFound = shard.hashMap.find(keys[index]);
+                if(shard.hashMap.end() != keyFound){
+                    if(this->renewOnAccess((*keyFound).second)){
+                        shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+                        values[index] = *(*keyFound).second.value.load(std::memory_order_relaxed);
+                        continue;
+                    }
+                    this->expireRecord(shard, keyFound);
+                }
+                auto removedFound = shard.writingBack.find(keys[index]);
+                if(shard.writingBack.end() != removedFound){
+                    values[index] = writtenBackValue((*removedFound).second);
+                    continue;
+                }
+                if(this->knownAbsent(shard, keys[index])){
+                    continue;
+                }
+                auto loadFound = shard.pendingLoads.find(keys[index]);
+                if(shard.pendingLoads.end() != loadFound){
+                    awaitedLoads.emplace_back(index, (*loadFound).second.result);
+                    continue;
+                }
+                ownLoads.push_back(OwnLoad{index, &shard, std::promise<Value>(), nullptr, false});
+                shard.pendingLoads.emplace(keys[index], PendingLoad{ownLoads.back().promise.get_future().share(), false});
+            }
+        }
+    } catch(...){
+        lockError = std::current_exception();
+    }
 
-    if(currentSize_ >= maxSize_){
-        removeRecords();
+    // positions of own loads to read, superseded ones are read again until they complete
+    std::vector<std::size_t> unresolved(ownLoads.size());
+    for(std::size_t position = 0; position < ownLoads.size(); ++position){
+        unresolved[position] = position;
     }
-    auto value = db_.find(key);
-    auto insertionRes = hashMap_.insert(std::make_pair<Key, ValueRecord>(Key(key), value));
+    while(!unresolved.empty()){
+        // all misses are read by single backend call under db lock and without shard locks
+        try{
+            std::vector<Key> loadKeys;
+            loadKeys.reserve(unresolved.size());
+            for(auto position : unresolved){
+                loadKeys.push_back(keys[ownLoads[position].index]);
+            }
+            std::vector<Value> loadedValues;
+            std::vector<bool> inDb;
+            {
+                std::lock_guard<std::mutex> dbLock{dbMtx_};
+                db_.findMany(loadKeys, loadedValues, inDb);
+            }
+            for(std::size_t loadIndex = 0; loadIndex < unresolved.size(); ++loadIndex){
+                auto& load = ownLoads[unresolved[loadIndex]];
+                load.inDb = inDb[loadIndex];
+                values[load.index] = load.inDb ? std::move(loadedValues[loadIndex]) : Value();
+            }
+        } catch(...){
+            for(auto position : unresolved){
+                ownLoads[position].error = std::current_exception();
+            }
+        }
+
+        std::vector<std::size_t> rereads;
+        std::size_t next{0};
+        while(next < unresolved.size()){
+            auto& shard = *ownLoads[unresolved[next]].shard;
+            // no timeout here, pending loads must be resolved in any case
+            boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx};
+            this->reclaimRetired(shard);
+            for(; next < unresolved.size() && &shard == ownLoads[unresolved[next]].shard; ++next){
+                auto& load = ownLoads[unresolved[next]];
+                const auto& key = keys[load.index];
+                auto loadFound = shard.pendingLoads.find(key);
+                if(!load.error && (*loadFound).second.superseded){
+                    // key was updated while loading, db value is outdated, see completeLoad
+                    auto keyFound = shard.hashMap.find(key);
+                    auto removedFound = shard.writingBack.find(key);
+                    if(shard.hashMap.end() != keyFound){
+                        values[load.index] = *(*keyFound).second.value.load(std::memory_order_relaxed);
+                    } else if(shard.writingBack.end() != removedFound){
+                        values[load.index] = writtenBackValue((*removedFound).second);
+                    } else {
+                        (*loadFound).second.superseded = false;
+                        rereads.push_back(unresolved[next]);
+                        continue;
+                    }
+                } else if(!load.error){
+                    // not superseded, so db value is the current one, see completeLoad
+                    try{
+                        if(!load.inDb && presenceFilter_){
+                            this->rememberAbsent(shard, key);
+                        } else {
+                            this->insertRecord(shard, key, values[load.index], this->writeDeadline());
+                        }
+                    } catch(...){
+                        load.error = std::current_exception();
+                    }
+                }
+                shard.pendingLoads.erase(loadFound);
+            }
+        }
+        unresolved.swap(rereads);
+    }
+
+    std::exception_ptr loadError;
+    for(auto& load : ownLoads){
+        if(load.error){
+            load.promise.set_exception(load.error);
+            loadError = loadError ? loadError : load.error;
+        } else {
+            load.promise.set_value(values[load.index]);
+        }
+    }
+    for(auto& shard : shards_){
+        this->writeBackRemoved(*shard);
+    }
+    if(lockError){
+        std::rethrow_exception(lockError);
+    }
+    if(loadError){
+        std::rethrow_exception(loadError);
+    }
+
+    for(auto& awaitedLoad : awaitedLoads){
+        if(std::future_status::ready != awaitedLoad.second.wait_for(std::chrono::microseconds{getAccessTimeoutUs_.count()})){
+            throw CacheTimeoutException();
+        }
+        values[awaitedLoad.first] = awaitedLoad.second.get();
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::updateRecord(Shard& shard, const Key& key, const Value& value,
+                                                                                          std::uint64_t expiresAt) {
+    this->applyUpdate(shard, shard.hashMap.find(key), key, value, expiresAt);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::applyUpdate(Shard& shard, typename RecordsMap::iterator keyFound,
+                                                                                         const Key& key, const Value& value,
+                                                                                         std::uint64_t expiresAt) {
+    // pending load of the key (if any) mustn't put the value it read over this one
+    auto loadFound = shard.pendingLoads.find(key);
+    if(shard.pendingLoads.end() != loadFound){
+        (*loadFound).second.superseded = true;
+    }
+    if(shard.hashMap.end() == keyFound){
+        this->forgetAbsent(shard, key);
+        // whole value is overwritten, no need to read it from db
+        auto& record = this->insertRecord(shard, key, value, expiresAt);
+        this->markDirty(shard, key, record);
+    } else {
+        auto& record = (*keyFound).second;
+        auto weight = this->weightOf(key, value);
+        auto currentWeight = shard.currentWeight.load(std::memory_order_relaxed);
+        if(weight > record.weight && currentWeight - record.weight + weight > shard.maxWeight){
+            // grown record doesn't fit, it's inserted again, so eviction makes room for it without picking it;
+            // new record is dirty as well, so nothing is lost
+            this->dropRecord(shard, keyFound);
+            auto& newRecord = this->insertRecord(shard, key, value, expiresAt);
+            this->markDirty(shard, key, newRecord);
+            return;
+        }
+        shard.recordLifetimeManager.touch(this->recordHandle(shard, keyFound));
+        this->replaceValue(shard, record, value);
+        shard.currentWeight.store(currentWeight - record.weight + weight, std::memory_order_relaxed);
+        record.weight = weight;
+        record.expiresAt.store(expiresAt, std::memory_order_relaxed);
+        this->scheduleExpiry(shard, key, record);
+        this->markDirty(shard, key, record);
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+typename ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::ValueRecord&
+ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::insertRecord(Shard& shard, const Key& key, const Value& value,
+                                                                                     std::uint64_t expiresAt) {
+    auto weight = this->weightOf(key, value);
+    if(shard.currentWeight.load(std::memory_order_relaxed) + weight > shard.maxWeight){
+        // full shard evicts a batch down to low watermark, so the next insertions find room without evicting;
+        // record heavier than the whole shard is kept alone
+        while(0 != shard.currentSize && shard.currentWeight.load(std::memory_order_relaxed) + weight > shard.lowWeight){
+            removeRecords(shard);
+        }
+    }
+    auto insertionRes = shard.hashMap.try_emplace(key, value);
     auto insertedSuccessfully = insertionRes.second;
     if(!insertedSuccessfully){
         throw CacheInternalException("Error inserting record in hashmap");
     }
     auto iter = insertionRes.first;
     try{
-        recordLifetimeManager_.addRecord(*iter);
+        shard.recordLifetimeManager.addRecord(this->recordHandle(shard, iter));
     } catch (const std::exception& ex){
-        // underlying recordLifetimeManager_ std::queue<std::deque> gives us strong exception
+        // underlying recordLifetimeManager std::queue<std::deque> gives us strong exception
         // safety guarantee, so we need to remove recently inserted record from hashmap to keep
         // hasmap and queue in consistency
-        hashMap_.erase(iter);
+        shard.hashMap.erase(iter);
         throw ex;
     }
 
-    ++currentSize_;
-    return (*iter).second;
+    ++shard.currentSize;
+    auto& record = (*iter).second;
+    record.weight = weight;
+    shard.currentWeight.fetch_add(weight, std::memory_order_relaxed);
+    record.ticket = ++shard.nextTicket;
+    record.expiresAt.store(expiresAt, std::memory_order_relaxed);
+    this->scheduleExpiry(shard, key, record);
+    if(shard.currentSize > 1 && shard.currentWeight.load(std::memory_order_relaxed) > shard.highWeight){
+        this->scheduleTrim(shard);
+    }
+    return record;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::scheduleExpiry(Shard& shard, const Key& key, ValueRecord& record) {
+    auto expiresAt = record.expiresAt.load(std::memory_order_relaxed);
+    // scheduled record stays in the wheel, deadline changed since is checked when it fires
+    if(0 != expiresAt && !record.scheduled){
+        shard.expiryWheel.schedule(ExpiryEntry{key, record.ticket}, expiresAt);
+        record.scheduled = true;
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::expireRecord(Shard& shard,
+                                                                                          typename RecordsMap::iterator keyFound) {
+    // dirty value is written back before the key is loaded from db again, loads read it from writingBack meanwhile
+    this->queueRemoved(shard, keyFound, RemovalCause::expired);
+    this->dropRecord(shard, keyFound);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::dropRecord(Shard& shard,
+                                                                                        typename RecordsMap::iterator keyFound) {
+    shard.recordLifetimeManager.removeRecord(this->recordHandle(shard, keyFound));
+    shard.currentWeight.fetch_sub((*keyFound).second.weight, std::memory_order_relaxed);
+    shard.hashMap.erase(keyFound);
+    --shard.currentSize;
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::expireRecords(Shard& shard) {
+    {
+        boost::shared_lock<ReadMostlySharedMutex> shardReadLock{shard.sharedMtx};
+        if(0 == shard.expiryWheel.size()){
+            return;
+        }
+    }
+    boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx};
+    this->reclaimRetired(shard);
+    auto now = this->expiryNow();
+    shard.expiryWheel.advance(now, [this, &shard, now](const ExpiryEntry& entry){
+        auto keyFound = shard.hashMap.find(entry.key);
+        if(shard.hashMap.end() == keyFound || entry.ticket != (*keyFound).second.ticket){
+            return; // evicted since scheduled
+        }
+        auto& record = (*keyFound).second;
+        auto expiresAt = record.expiresAt.load(std::memory_order_relaxed);
+        if(0 == expiresAt){
+            record.scheduled = false;
+        } else if(expiresAt > now){
+            // extended by hits or updates since scheduled
+            shard.expiryWheel.schedule(entry, expiresAt);
+        } else {
+            this->expireRecord(shard, keyFound);
+        }
+    });
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::markDirty(Shard& shard, const Key& key, ValueRecord& record) {
+    // caller holds record lock or shard write lock, only the first modification since last sync lists the key
+    if(!record.dirty){
+        shard.dirtyKeys.push(key);
+        record.dirty = true;
+        if(0 == syncDirtyThreshold_ && 0 == writeBehindDelay_.count()){
+            return;
+        }
+        // only the record opening write behind batch or reaching the threshold wakes sync thread, under its mutex,
+        // so wake up isn't lost
+        auto dirtyCount = dirtyCount_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if((0 != writeBehindDelay_.count() && 1 == dirtyCount) || syncDirtyThreshold_ == dirtyCount){
+            std::lock_guard<std::mutex> syncLock{syncMtx_};
+            syncCondition_.notify_all();
+        }
+    }
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::publishValue(Shard& shard, ValueRecord& record,
+                                                                                          const Value& value) {
+    std::unique_ptr<const Value> newValue{new Value(value)};
+    std::lock_guard<std::mutex> retiredLock{shard.retiredMtx};
+    shard.retiredValues.reserve(shard.retiredValues.size() + 1); // the only operation which may throw
+    auto oldValue = record.value.exchange(newValue.release(), std::memory_order_acq_rel);
+    shard.retiredValues.push_back(oldValue);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::replaceValue(Shard&, ValueRecord& record,
+                                                                                          const Value& value) {
+    std::unique_ptr<const Value> newValue{new Value(value)};
+    // no readers under shard write lock, old snapshot may be deleted right away
+    delete record.value.exchange(newValue.release(), std::memory_order_relaxed);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::reclaimRetired(Shard& shard) {
+    // write lock waited for all readers to leave, none of them holds retired snapshot anymore
+    std::lock_guard<std::mutex> retiredLock{shard.retiredMtx};
+    for(auto retiredValue : shard.retiredValues){
+        delete retiredValue;
+    }
+    shard.retiredValues.clear();
 }
 
 
-template<typename Key, typename Value, typename Hasher>
-void ConcurrentCache<Key, Value, Hasher>::removeRecords() {
-   auto recordToRemove = recordLifetimeManager_.getRecordToRemove();
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::removeRecords(Shard& shard) {
+   auto recordToRemove = shard.recordLifetimeManager.getRecordToRemove();
    // at this moment record already removed from lifetime manager queue, but still contains in hashmap
    // erase method doesn't throw exception other than those thrown by the hash object ot equality predicate,
    // so need to be careful using own hasher and equality predicate
-   auto deleted = hashMap_.erase((*recordToRemove).get().first);
-   if(1!=deleted){
+   auto keyFound = shard.hashMap.findHandle((*recordToRemove).id);
+   if(shard.hashMap.end() == keyFound){
        throw CacheInternalException("Record in lifetime manager haven't appropriate record in hashmap");
    }
-   --currentSize_;
+   auto weight = (*keyFound).second.weight;
+   this->queueRemoved(shard, keyFound, RemovalCause::evicted);
+   shard.hashMap.erase(keyFound);
+   --shard.currentSize;
+   shard.currentWeight.fetch_sub(weight, std::memory_order_relaxed);
+
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::scheduleTrim(Shard& shard) {
+    if(shard.trimScheduled.exchange(true)){
+        return;
+    }
+    try{
+        loaders_.submit([this, &shard](){
+            this->trimShard(shard);
+        });
+    } catch(...){
+        // shard is trimmed by the next insertion over the high watermark or evicts on overflow as usual
+        shard.trimScheduled.store(false);
+    }
+}
 
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::trimShard(Shard& shard) {
+    // flag is cleared before trimming, so insertion made after trim checked the weight schedules another one
+    shard.trimScheduled.store(false);
+    boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx, getAccessTimeoutUs_};
+    if(!shardWriteLock.owns_lock()){
+        return; // shard is busy, the next insertion over the high watermark retries
+    }
+    this->reclaimRetired(shard);
+    while(shard.currentSize > 1 && shard.currentWeight.load(std::memory_order_relaxed) > shard.lowWeight){
+        removeRecords(shard);
+    }
+    shardWriteLock.unlock();
+    this->writeBackRemoved(shard);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::queueRemoved(Shard& shard,
+                                                                                          typename RecordsMap::iterator keyFound,
+                                                                                          RemovalCause cause) {
+    auto& record = (*keyFound).second;
+    // removed key is deleted from db, even if its record is clean
+    bool writeBack{record.dirty || RemovalCause::removed == cause};
+    if(!writeBack && !removalListener_){
+        return; // neither db nor listener needs it
+    }
+    shard.removedRecords.push_back(RemovedRecord{(*keyFound).first, nullptr, writeBack, cause});
+    if(writeBack){
+        try{
+            shard.writingBack[(*keyFound).first] = RemovalCause::removed == cause ?
+                                                   nullptr : record.value.load(std::memory_order_relaxed);
+        } catch(...){
+            shard.removedRecords.pop_back();
+            throw;
+        }
+    }
+    // nothing throws below, record gives its snapshot away, no readers under shard write lock
+    shard.removedRecords.back().value.reset(record.value.exchange(nullptr, std::memory_order_relaxed));
+    shard.removedPending.store(true, std::memory_order_release);
+}
+
+
+template<typename Key, typename Value, typename Hasher, template<typename> class LifetimeManager, typename Weigher, typename Backend>
+void ConcurrentCache<Key, Value, Hasher, LifetimeManager, Weigher, Backend>::writeBackRemoved(Shard& shard) {
+    if(!shard.removedPending.load(std::memory_order_acquire)){
+        return;
+    }
+    std::unique_lock<std::mutex> writeBackLock{shard.writeBackMtx};
+    std::vector<RemovedRecord> removedRecords;
+    {
+        // no timeout here and below, removed values must reach db in any case
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx};
+        removedRecords.swap(shard.removedRecords);
+        shard.removedPending.store(false, std::memory_order_relaxed);
+    }
+    if(removedRecords.empty()){
+        return; // handled by another thread
+    }
+
+    std::exception_ptr writeError;
+    try{
+        std::lock_guard<std::mutex> dbLock{dbMtx_};
+        for(const auto& removed : removedRecords){
+            if(RemovalCause::removed == removed.cause){
+                db_.remove(removed.key);
+            } else if(removed.dirty){
+                db_.update(removed.key, *removed.value);
+            }
+        }
+    } catch(...){
+        writeError = std::current_exception();
+    }
+
+    {
+        boost::unique_lock<ReadMostlySharedMutex> shardWriteLock{shard.sharedMtx};
+        if(writeError){
+            // the batch stays readable from writingBack and is written again by the next write back, ahead of
+            // records removed since
+            std::move(std::begin(shard.removedRecords), std::end(shard.removedRecords), std::back_inserter(removedRecords));
+            shard.removedRecords.swap(removedRecords);
+            shard.removedPending.store(true, std::memory_order_release);
+        } else {
+            for(const auto& removed : removedRecords){
+                auto removedFound = shard.writingBack.find(removed.key);
+                const Value* writtenValue = RemovalCause::removed == removed.cause ? nullptr : removed.value.get();
+                // the key could be loaded, updated and removed again meanwhile, newer value stays until its write back
+                if(removed.dirty && shard.writingBack.end() != removedFound && writtenValue == (*removedFound).second){
+                    shard.writingBack.erase(removedFound);
+                }
+            }
+        }
+    }
+    if(writeError){
+        std::rethrow_exception(writeError);
+    }
+    // listener may use the cache and evict records of this shard, so the next write back must not wait for it
+    writeBackLock.unlock();
+
+    if(removalListener_){
+        for(const auto& removed : removedRecords){
+            if(!removed.value){
+                continue; // removed key wasn't cached
+            }
+            try{
+                removalListener_(removed.key, *removed.value, removed.cause);
+            } catch(...){
+                // listener errors are none of the caller's business
+            }
+        }
+    }
 }
 
 
@@ -0,0 +1,484 @@
+#ifndef FLAT_HASH_MAP_H
+#define FLAT_HASH_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "boost/noncopyable.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace concurrent_cache{
+
+
+// 16 control bytes of the table probed at once, with SSE2 when available
+class ControlGroup{
+    public:
+        static const std::size_t width = 16;
+        static const std::int8_t emptyCtrl = -128;
+        static const std::int8_t deletedCtrl = -2;
+        // full slots hold low 7 bits of the key hash, so full control bytes are never negative
+
+        explicit ControlGroup(const std::int8_t* ctrl)
+#ifdef __SSE2__
+            :ctrl_{_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))}{
+#else
+            :ctrl_{ctrl}{
+#endif
+        }
+
+        // bit i is set if slot i may hold key with such hash bits
+        std::uint32_t match(std::int8_t hashBits) const{
+#ifdef __SSE2__
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(hashBits), ctrl_)));
+#else
+            return matchIf([hashBits](std::int8_t ctrl){ return ctrl == hashBits; });
+#endif
+        }
+
+        std::uint32_t matchEmpty() const{
+#ifdef __SSE2__
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(emptyCtrl), ctrl_)));
+#else
+            return matchIf([](std::int8_t ctrl){ return ctrl == emptyCtrl; });
+#endif
+        }
+
+        std::uint32_t matchEmptyOrDeleted() const{
+#ifdef __SSE2__
+            // empty and deleted are the only negative control bytes
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl_));
+#else
+            return matchIf([](std::int8_t ctrl){ return ctrl < 0; });
+#endif
+        }
+
+    private:
+#ifdef __SSE2__
+        __m128i ctrl_;
+#else
+        template<typename Predicate>
+        std::uint32_t matchIf(Predicate predicate) const{
+            std::uint32_t mask{0};
+            for(std::size_t index = 0; index < width; ++index){
+                if(predicate(ctrl_[index])){
+                    mask |= 1u << index;
+                }
+            }
+            return mask;
+        }
+
+        const std::int8_t* ctrl_;
+#endif
+};
+
+
+// open addressing hash map in the spirit of Swiss tables: control bytes with 7 hash bits per slot are probed
+// a group of 16 at a time, so a lookup usually reads one control cache line and the slot whose hash bits match,
+// entries are stored in the slots themselves. Rehash moves entries, so iterators and references are invalidated
+// by insertion; every entry gets a handle instead, which stays valid until the entry is erased (lifetime
+// managers keep records by handles). Handles of erased entries are reused.
+// Groups are aligned and probed in triangular sequence, which visits every group of power of two table
+template<typename Key, typename Mapped, typename Hasher = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap : boost::noncopyable  {
+    public:
+        typedef std::pair<const Key, Mapped> value_type;
+        typedef std::uint32_t handle_type;
+
+        class iterator{
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef typename FlatHashMap::value_type value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef value_type* pointer;
+                typedef value_type& reference;
+
+                iterator()
+                    :map_{nullptr},
+                     slot_{0}{}
+                value_type& operator*() const{
+                    return *map_->entry(slot_);
+                }
+                value_type* operator->() const{
+                    return map_->entry(slot_);
+                }
+                iterator& operator++(){
+                    slot_ = map_->nextFull(slot_ + 1);
+                    return *this;
+                }
+                iterator operator++(int){
+                    auto previous = *this;
+                    ++*this;
+                    return previous;
+                }
+                bool operator==(const iterator& other) const{
+                    return slot_ == other.slot_;
+                }
+                bool operator!=(const iterator& other) const{
+                    return slot_ != other.slot_;
+                }
+
+            private:
+                friend class FlatHashMap;
+                iterator(FlatHashMap* map, std::size_t slot)
+                    :map_{map},
+                     slot_{slot}{}
+
+                FlatHashMap* map_;
+                std::size_t slot_;
+        };
+
+        FlatHashMap();
+        ~FlatHashMap();
+
+        iterator begin();
+        iterator end();
+        iterator find(const Key& key);
+        // entry the handle was given to, end if it has been erased
+        iterator findHandle(handle_type handle);
+        handle_type handle(iterator position) const;
+        // starts loading control bytes of the first group probed for key, so lookups of several keys issued
+        // after their prefetches wait for memory in parallel rather than one after another
+        void prefetch(const Key& key) const;
+        // constructs mapped value from args if there is no such key yet, like C++17 std::unordered_map::try_emplace
+        template<typename... Args>
+        std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+        void erase(iterator position);
+        std::size_t erase(const Key& key);
+        std::size_t size() const;
+        bool empty() const;
+
+    private:
+        // entries are constructed as value_type, rehash moves them as pair of non const key and mapped value
+        // (the same layout), so the key is moved rather than copied
+        typedef std::pair<Key, Mapped> MovableValue;
+        typedef typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type Slot;
+        static const handle_type noHandle = static_cast<handle_type>(-1);
+
+        // load factor is at most 7/8
+        static std::size_t maxLoad(std::size_t capacity){
+            return capacity - capacity / 8;
+        }
+
+        value_type* entry(std::size_t slot) const;
+        std::size_t hashOf(const Key& key) const;
+        std::size_t capacity() const;
+        std::size_t nextFull(std::size_t slot) const;
+        // first empty or deleted slot on probe sequence of hash
+        std::size_t findInsertSlot(std::size_t hash) const;
+        void rehash(std::size_t groupsCount);
+        handle_type allocateHandle();
+
+        std::vector<std::int8_t> ctrl_;
+        std::unique_ptr<Slot[]> slots_;
+        // handle of entry in each slot
+        std::vector<handle_type> slotHandles_;
+        // slot of each handle given out; handle free for reuse holds the next free handle instead
+        std::vector<std::uint32_t> handleSlots_;
+        handle_type freeHandle_;
+        std::size_t groupsCount_;
+        std::size_t size_;
+        // empty slots which may be filled before exceeding max load, reusing deleted slot doesn't count
+        std::size_t growthLeft_;
+        Hasher hasher_;
+        KeyEqual keyEqual_;
+};
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::FlatHashMap()
+    :ctrl_(ControlGroup::width, std::int8_t{ControlGroup::emptyCtrl}),
+     slots_{new Slot[ControlGroup::width]},
+     slotHandles_(ControlGroup::width, handle_type{noHandle}),
+     freeHandle_{noHandle},
+     groupsCount_{1},
+     size_{0},
+     growthLeft_{maxLoad(ControlGroup::width)}{
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::~FlatHashMap() {
+    for(std::size_t slot = 0; slot < capacity(); ++slot){
+        if(ctrl_[slot] >= 0){
+            entry(slot)->~value_type();
+        }
+    }
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::iterator FlatHashMap<Key, Mapped, Hasher, KeyEqual>::begin() {
+    return iterator{this, nextFull(0)};
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::iterator FlatHashMap<Key, Mapped, Hasher, KeyEqual>::end() {
+    return iterator{this, capacity()};
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::iterator
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::find(const Key& key) {
+    auto hash = hashOf(key);
+    auto hashBits = static_cast<std::int8_t>(hash & 0x7F);
+    auto groupMask = groupsCount_ - 1;
+    auto group = (hash >> 7) & groupMask;
+    for(std::size_t step = 1; ; ++step){
+        ControlGroup controlGroup{&ctrl_[group * ControlGroup::width]};
+        for(auto candidates = controlGroup.match(hashBits); 0 != candidates; candidates &= candidates - 1){
+            auto slot = group * ControlGroup::width + __builtin_ctz(candidates);
+            if(keyEqual_(entry(slot)->first, key)){
+                return iterator{this, slot};
+            }
+        }
+        // key would have been placed into this group, if it had been inserted
+        if(0 != controlGroup.matchEmpty()){
+            return end();
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::iterator
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::findHandle(handle_type handle) {
+    // free handle holds another handle rather than a slot, the slot is checked to own the handle
+    if(handle >= handleSlots_.size()){
+        return end();
+    }
+    auto slot = static_cast<std::size_t>(handleSlots_[handle]);
+    if(slot >= capacity() || ctrl_[slot] < 0 || slotHandles_[slot] != handle){
+        return end();
+    }
+    return iterator{this, slot};
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::handle_type
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::handle(iterator position) const {
+    return slotHandles_[position.slot_];
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+void FlatHashMap<Key, Mapped, Hasher, KeyEqual>::prefetch(const Key& key) const {
+    auto group = (hashOf(key) >> 7) & (groupsCount_ - 1);
+    __builtin_prefetch(&ctrl_[group * ControlGroup::width]);
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+template<typename... Args>
+std::pair<typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::iterator, bool>
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::try_emplace(const Key& key, Args&&... args) {
+    auto found = find(key);
+    if(end() != found){
+        return std::make_pair(found, false);
+    }
+
+    auto hash = hashOf(key);
+    auto slot = findInsertSlot(hash);
+    if(0 == growthLeft_ && ControlGroup::emptyCtrl == ctrl_[slot]){
+        // many deleted slots, cleaning them up is enough, otherwise grow
+        rehash(2 * size_ < maxLoad(capacity()) ? groupsCount_ : 2 * groupsCount_);
+        slot = findInsertSlot(hash);
+    }
+
+    auto handle = allocateHandle();
+    try{
+        new (&slots_[slot]) value_type(std::piecewise_construct, std::forward_as_tuple(key),
+                                       std::forward_as_tuple(std::forward<Args>(args)...));
+    } catch(...){
+        handleSlots_[handle] = freeHandle_;
+        freeHandle_ = handle;
+        throw;
+    }
+    if(ControlGroup::emptyCtrl == ctrl_[slot]){
+        --growthLeft_;
+    }
+    ctrl_[slot] = static_cast<std::int8_t>(hash & 0x7F);
+    slotHandles_[slot] = handle;
+    handleSlots_[handle] = static_cast<std::uint32_t>(slot);
+    ++size_;
+    return std::make_pair(iterator{this, slot}, true);
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+void FlatHashMap<Key, Mapped, Hasher, KeyEqual>::erase(iterator position) {
+    auto slot = position.slot_;
+    entry(slot)->~value_type();
+    auto handle = slotHandles_[slot];
+    handleSlots_[handle] = freeHandle_;
+    freeHandle_ = handle;
+    slotHandles_[slot] = noHandle;
+    --size_;
+    // lookups stop at group having empty slot, if this group has one, no probe sequence passes it and
+    // slot may become empty, otherwise it must stay deleted to keep probe sequences going through it
+    auto groupStart = slot - slot % ControlGroup::width;
+    if(0 != ControlGroup{&ctrl_[groupStart]}.matchEmpty()){
+        ctrl_[slot] = ControlGroup::emptyCtrl;
+        ++growthLeft_;
+    } else {
+        ctrl_[slot] = ControlGroup::deletedCtrl;
+    }
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::erase(const Key& key) {
+    auto found = find(key);
+    if(end() == found){
+        return 0;
+    }
+    erase(found);
+    return 1;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::size() const {
+    return size_;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+bool FlatHashMap<Key, Mapped, Hasher, KeyEqual>::empty() const {
+    return 0 == size_;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::value_type*
+FlatHashMap<Key, Mapped, Hasher, KeyEqual>::entry(std::size_t slot) const {
+    return reinterpret_cast<value_type*>(&slots_[slot]);
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::hashOf(const Key& key) const {
+    // std::hash of integers is identity, mix all bits (murmur3 finalizer), so both hash bits in control
+    // byte and group index are well distributed
+    std::uint64_t hash = static_cast<std::uint64_t>(hasher_(key));
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return static_cast<std::size_t>(hash);
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::capacity() const {
+    return groupsCount_ * ControlGroup::width;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::nextFull(std::size_t slot) const {
+    while(slot < capacity() && ctrl_[slot] < 0){
+        ++slot;
+    }
+    return slot;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+std::size_t FlatHashMap<Key, Mapped, Hasher, KeyEqual>::findInsertSlot(std::size_t hash) const {
+    auto groupMask = groupsCount_ - 1;
+    auto group = (hash >> 7) & groupMask;
+    for(std::size_t step = 1; ; ++step){
+        auto available = ControlGroup{&ctrl_[group * ControlGroup::width]}.matchEmptyOrDeleted();
+        if(0 != available){
+            return group * ControlGroup::width + __builtin_ctz(available);
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+void FlatHashMap<Key, Mapped, Hasher, KeyEqual>::rehash(std::size_t groupsCount) {
+    auto newCapacity = groupsCount * ControlGroup::width;
+    if(newCapacity > static_cast<std::size_t>(noHandle)){
+        throw std::length_error("FlatHashMap is too large");
+    }
+    std::vector<std::int8_t> ctrl(newCapacity, std::int8_t{ControlGroup::emptyCtrl});
+    std::unique_ptr<Slot[]> slots{new Slot[newCapacity]};
+    std::vector<handle_type> slotHandles(newCapacity, handle_type{noHandle});
+    std::swap(ctrl, ctrl_);
+    std::swap(slots, slots_);
+    std::swap(slotHandles, slotHandles_);
+    auto oldGroupsCount = groupsCount_;
+    groupsCount_ = groupsCount;
+
+    // like std::vector, entries are moved if that can't throw, otherwise copied, so the old table stays intact
+    // until the new one is filled
+    std::vector<std::size_t> moved;
+    try{
+        moved.reserve(size_);
+        for(std::size_t slot = 0; slot < ctrl.size(); ++slot){
+            if(ctrl[slot] >= 0){
+                auto& movable = *reinterpret_cast<MovableValue*>(&slots[slot]);
+                auto hash = hashOf(movable.first);
+                auto newSlot = findInsertSlot(hash);
+                new (&slots_[newSlot]) MovableValue(std::move_if_noexcept(movable));
+                ctrl_[newSlot] = static_cast<std::int8_t>(hash & 0x7F);
+                moved.push_back(newSlot);
+            }
+        }
+    } catch(...){
+        for(auto newSlot : moved){
+            entry(newSlot)->~value_type();
+        }
+        std::swap(ctrl, ctrl_);
+        std::swap(slots, slots_);
+        std::swap(slotHandles, slotHandles_);
+        groupsCount_ = oldGroupsCount;
+        throw;
+    }
+
+    std::size_t movedIndex{0};
+    for(std::size_t slot = 0; slot < ctrl.size(); ++slot){
+        if(ctrl[slot] >= 0){
+            reinterpret_cast<value_type*>(&slots[slot])->~value_type();
+            auto newSlot = moved[movedIndex++];
+            slotHandles_[newSlot] = slotHandles[slot];
+            handleSlots_[slotHandles[slot]] = static_cast<std::uint32_t>(newSlot);
+        }
+    }
+    growthLeft_ = maxLoad(capacity()) - size_;
+}
+
+
+template<typename Key, typename Mapped, typename Hasher, typename KeyEqual>
+typename FlatHashMap<Key, Mapped, Hasher, KeyEqual>::handle_type FlatHashMap<Key, Mapped, Hasher, KeyEqual>::allocateHandle() {
+    if(noHandle != freeHandle_){
+        auto handle = freeHandle_;
+        freeHandle_ = handleSlots_[handle];
+        return handle;
+    }
+    // table never holds more entries than its capacity, which is below noHandle
+    handleSlots_.push_back(0);
+    return static_cast<handle_type>(handleSlots_.size() - 1);
+}
+
+
+} // namespace
+#endif // FLAT_HASH_MAP_H
@@ -0,0 +1,108 @@
+#ifndef FREQUENCY_SKETCH_H
+#define FREQUENCY_SKETCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "boost/noncopyable.hpp"
+
+
+namespace concurrent_cache{
+
+
+// count-min sketch of 4-bit saturating counters used to estimate how often a key was requested recently;
+// all counters are halved once number of increments reaches sample size, so old popularity fades out
+class FrequencySketch : boost::noncopyable  {
+    public:
+        FrequencySketch();
+        // sketch grows together with the cache, counters are dropped on growth
+        void ensureCapacity(std::size_t capacity);
+        void increment(std::size_t hash);
+        std::uint8_t frequency(std::size_t hash) const;
+
+    private:
+        static const std::size_t depth = 4;
+        static const std::size_t minWidth = 64;
+        static const std::uint8_t maxCounter = 15;
+        // count of increments before aging, relative to capacity
+        static const std::size_t samplesPerEntry = 10;
+
+        std::size_t indexOf(std::size_t hash, std::size_t row) const;
+        void age();
+
+        std::vector<std::uint8_t> counters_;
+        std::size_t width_;
+        std::size_t capacity_;
+        std::size_t additions_;
+};
+
+
+inline FrequencySketch::FrequencySketch()
+    :counters_(depth * minWidth, 0),
+     width_{minWidth},
+     capacity_{0},
+     additions_{0}{
+}
+
+
+inline void FrequencySketch::ensureCapacity(std::size_t capacity) {
+    if(capacity <= capacity_){
+        return;
+    }
+    // double capacity, so frequent growth doesn't drop the counters each time
+    capacity_ = std::max(capacity, 2 * capacity_);
+    std::size_t width{minWidth};
+    while(width < capacity_){
+        width <<= 1;
+    }
+    if(width != width_){
+        counters_.assign(depth * width, 0);
+        width_ = width;
+        additions_ = 0;
+    }
+}
+
+
+inline void FrequencySketch::increment(std::size_t hash) {
+    bool incremented{false};
+    for(std::size_t row = 0; row < depth; ++row){
+        auto& counter = counters_[this->indexOf(hash, row)];
+        if(counter < maxCounter){
+            ++counter;
+            incremented = true;
+        }
+    }
+    if(incremented && ++additions_ >= samplesPerEntry * (capacity_ > minWidth ? capacity_ : minWidth)){
+        this->age();
+    }
+}
+
+
+inline std::uint8_t FrequencySketch::frequency(std::size_t hash) const {
+    std::uint8_t minCounter{maxCounter};
+    for(std::size_t row = 0; row < depth; ++row){
+        minCounter = std::min(minCounter, counters_[this->indexOf(hash, row)]);
+    }
+    return minCounter;
+}
+
+
+inline std::size_t FrequencySketch::indexOf(std::size_t hash, std::size_t row) const {
+    static const std::uint64_t seeds[depth] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+                                               0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+    std::uint64_t mixed = (static_cast<std::uint64_t>(hash) + row) * seeds[row];
+    mixed ^= mixed >> 32;
+    return row * width_ + (mixed & (width_ - 1));
+}
+
+
+inline void FrequencySketch::age() {
+    for(auto& counter : counters_){
+        counter >>= 1;
+    }
+    additions_ /= 2;
+}
+
+
+} // namespace
+#endif // FREQUENCY_SKETCH_H
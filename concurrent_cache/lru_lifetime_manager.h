@@ -0,0 +1,91 @@
+#ifndef LRU_LIFETIME_MANAGER_H
+#define LRU_LIFETIME_MANAGER_H
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "record_lifetime_manager.h"
+
+
+namespace concurrent_cache{
+
+
+template<typename Record>
+class LruRecordLifetimeManager : boost::noncopyable  {
+    public:
+        LruRecordLifetimeManager() = default;
+        void addRecord(const Record& record);
+        void touch(const Record& record);
+        std::shared_ptr<Record> getRecordToRemove();
+        // record leaves the cache other way than eviction (e.g. expires), record must be managed
+        void removeRecord(const Record& record);
+
+    private:
+        typedef RecordTraits<Record> Traits;
+        typedef typename std::list<Record>::iterator Position;
+
+        // hits come concurrently under shard reader lock, reordering the list needs own lock
+        std::mutex mtx_;
+        // most recently used records are at front
+        std::list<Record> records_;
+        std::unordered_map<typename Traits::Id, Position> positions_;
+};
+
+
+template<typename Record>
+void LruRecordLifetimeManager<Record>::addRecord(const Record& record) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    records_.push_front(record);
+    try{
+        auto insertionRes = positions_.emplace(Traits::id(record), std::begin(records_));
+        if(!insertionRes.second){
+            // record is already managed, treat as a hit
+            records_.pop_front();
+            records_.splice(std::begin(records_), records_, (*insertionRes.first).second);
+        }
+    } catch(...){
+        records_.pop_front();
+        throw;
+    }
+}
+
+
+template<typename Record>
+void LruRecordLifetimeManager<Record>::touch(const Record& record) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        records_.splice(std::begin(records_), records_, (*positionFound).second);
+    }
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> LruRecordLifetimeManager<Record>::getRecordToRemove(){
+    std::lock_guard<std::mutex> lock{mtx_};
+    if(records_.empty()){
+        throw QueueEmpty();
+    }
+    std::shared_ptr<Record> recordToRemove{std::make_shared<Record>(records_.back())};
+    positions_.erase(Traits::id(records_.back()));
+    records_.pop_back();
+    return recordToRemove;
+}
+
+
+template<typename Record>
+void LruRecordLifetimeManager<Record>::removeRecord(const Record& record){
+    std::lock_guard<std::mutex> lock{mtx_};
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        records_.erase((*positionFound).second);
+        positions_.erase(positionFound);
+    }
+}
+
+
+} // namespace
+#endif // LRU_LIFETIME_MANAGER_H
@@ -0,0 +1,535 @@
+#ifndef MAPPED_HASH_FILE_H
+#define MAPPED_HASH_FILE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "cache_options.h"
+#include "codec.h"
+
+
+namespace concurrent_cache{
+
+
+// on-disk open addressing hash table of encoded keys and values accessed through mmap, only the index is checked
+// on startup (and rebuilt from data if it doesn't match), lookups touch one bucket run and one record, so only data
+// pages of used keys become resident.
+// Two files are used:
+//     <fileName>        data header, then records [key size][value capacity][value size][key][value]
+//     <fileName>.index  index header, then power of two array of buckets {key hash, record offset}
+// value shorter than record capacity is overwritten in place, longer one is appended as new record
+// (old one becomes garbage); index is rebuilt twice larger when load factor exceeds maxLoadPercent.
+// Removed key's record is flagged and becomes garbage, its bucket is freed by shifting the rest of probe run back
+class MappedHashFile : boost::noncopyable  {
+    public:
+        MappedHashFile(const std::string& fileName, const DbOptions& options);
+        ~MappedHashFile();
+
+        // returns false if there is no such key, value is left untouched then. Value points to the mapping and
+        // is valid until next update
+        bool find(const ByteView& key, ByteView& value) const;
+        void update(const ByteView& key, const ByteView& value);
+        // no-op if there is no such key
+        void remove(const ByteView& key);
+        // msync mappings according to fsync policy
+        void flush();
+        // count of keys
+        std::uint64_t size() const;
+        // calls visitor(key) for every key, walks the whole index and touches every record
+        template<typename Visitor>
+        void forEachKey(Visitor visitor) const;
+
+    private:
+        struct Mapping{
+                int fd{-1};
+                char* data{nullptr};
+                std::uint64_t size{0};
+        };
+        struct IndexHeader{
+                std::uint64_t magic;
+                std::uint64_t bucketsCount;
+                std::uint64_t usedBuckets;
+        };
+        struct DataHeader{
+                std::uint64_t magic;
+                std::uint64_t dataEnd;
+        };
+        struct Bucket{
+                std::uint64_t hash;
+                std::uint64_t offset; // 0 for empty bucket, records never start at 0 since data header is there
+        };
+        struct RecordHeader{
+                std::uint32_t keySize;
+                std::uint32_t valueCapacity;
+                std::uint32_t valueSize;
+                std::uint32_t flags;
+        };
+
+        static const std::uint64_t indexMagic = 0x31584449484d4343ull; // "CCMHIDX1"
+        static const std::uint64_t dataMagic = 0x31544144484d4343ull;  // "CCMHDAT1"
+        static const std::uint64_t initialBucketsCount = 1024;
+        static const std::uint64_t initialDataSize = 64 * 1024;
+        static const std::uint64_t maxLoadPercent = 70;
+        // records are 8 bytes aligned, value capacity is rounded up to it as well leaving room to grow in place
+        static const std::uint64_t recordAlignment = 8;
+        // record flag, the key was removed after the record was written; index rebuild drops it
+        static const std::uint32_t removedFlag = 1;
+
+        static std::uint64_t hashOf(const ByteView& key);
+        static std::uint64_t align(std::uint64_t size);
+        static std::uint64_t indexSize(std::uint64_t bucketsCount);
+        // returns true if file was created (or was empty)
+        bool openMapping(Mapping& mapping, const std::string& fileName, std::uint64_t initialSize);
+        void closeMapping(Mapping& mapping);
+        void resizeMapping(Mapping& mapping, std::uint64_t newSize);
+        void syncMapping(Mapping& mapping);
+        void initIndex(Mapping& mapping, std::uint64_t bucketsCount);
+        // index header matches mapping size and every bucket points inside data written, walks the whole index
+        bool indexValid() const;
+
+        const IndexHeader& indexHeader() const;
+        IndexHeader& indexHeader();
+        Bucket* buckets() const;
+        DataHeader& dataHeader() const;
+        RecordHeader& recordAt(std::uint64_t offset) const;
+        // bucket holding key, or empty bucket where key should be placed
+        Bucket& findBucket(std::uint64_t hash, const ByteView& key) const;
+        // empties used bucket, keeping the rest of its probe run reachable
+        void eraseBucket(Bucket& bucket);
+        std::uint64_t appendRecord(const ByteView& key, const ByteView& value);
+        void rehash();
+        // index is lost but data isn't, walk records and point buckets to latest record of each key
+        void rebuildIndex();
+        void throwIoError(const char* operation, const std::string& fileName);
+
+        std::string fileName_;
+        std::string indexFileName_;
+        DbOptions options_;
+        Mapping data_;
+        Mapping index_;
+};
+
+
+inline MappedHashFile::MappedHashFile(const std::string& fileName, const DbOptions& options)
+    :fileName_{fileName},
+     indexFileName_{fileName + ".index"},
+     options_(options){
+    try{
+        bool dataCreated = openMapping(data_, fileName_, initialDataSize);
+        if(dataCreated){
+            dataHeader().magic = dataMagic;
+            dataHeader().dataEnd = align(sizeof(DataHeader));
+            // index left from removed data file points to records which aren't there
+            ::unlink(indexFileName_.c_str());
+        } else if(data_.size < sizeof(DataHeader) || dataMagic != dataHeader().magic){
+            throw DbParseException("Mapped hash db data file has wrong format");
+        } else if(dataHeader().dataEnd < align(sizeof(DataHeader)) || dataHeader().dataEnd > data_.size){
+            throw DbParseException("Mapped hash db data file is truncated");
+        }
+        if(openMapping(index_, indexFileName_, indexSize(initialBucketsCount))){
+            initIndex(index_, initialBucketsCount);
+            rebuildIndex();
+        } else if(!indexValid()){
+            // index is derived from data, so broken one (or one of another data file) is just built again
+            closeMapping(index_);
+            if(0 != ::unlink(indexFileName_.c_str())){
+                throwIoError("unlink", indexFileName_);
+            }
+            openMapping(index_, indexFileName_, indexSize(initialBucketsCount));
+            initIndex(index_, initialBucketsCount);
+            rebuildIndex();
+        }
+    } catch(...){
+        closeMapping(index_);
+        closeMapping(data_);
+        throw;
+    }
+}
+
+
+inline MappedHashFile::~MappedHashFile() {
+    try{
+        flush();
+    } catch (const std::exception& ex){
+        std::cerr << ex.what() << std::endl; // log somewhere
+    } catch(...){
+        std::cerr << "unexpected exception" << std::endl; // log somewhere
+    }
+    closeMapping(index_);
+    closeMapping(data_);
+}
+
+
+inline bool MappedHashFile::find(const ByteView& key, ByteView& value) const {
+    auto& bucket = findBucket(hashOf(key), key);
+    if(0 == bucket.offset){
+        return false;
+    }
+    auto& record = recordAt(bucket.offset);
+    value.data = reinterpret_cast<const char*>(&record + 1) + record.keySize;
+    value.size = record.valueSize;
+    return true;
+}
+
+
+inline void MappedHashFile::update(const ByteView& key, const ByteView& value) {
+    if((indexHeader().usedBuckets + 1) * 100 > indexHeader().bucketsCount * maxLoadPercent){
+        rehash();
+    }
+
+    auto hash = hashOf(key);
+    auto& bucket = findBucket(hash, key);
+    if(0 != bucket.offset){
+        auto& record = recordAt(bucket.offset);
+        if(value.size <= record.valueCapacity){
+            std::memcpy(reinterpret_cast<char*>(&record + 1) + record.keySize, value.data, value.size);
+            record.valueSize = static_cast<std::uint32_t>(value.size);
+            if(DbOptions::FsyncPolicy::always == options_.fsyncPolicy){
+                flush();
+            }
+            return;
+        }
+    }
+
+    // appending may remap data file only, so bucket reference stays valid
+    auto offset = appendRecord(key, value);
+    if(0 == bucket.offset){
+        ++indexHeader().usedBuckets;
+    }
+    bucket.hash = hash;
+    // record is completely written before bucket points to it
+    bucket.offset = offset;
+    if(DbOptions::FsyncPolicy::always == options_.fsyncPolicy){
+        flush();
+    }
+}
+
+
+inline void MappedHashFile::remove(const ByteView& key) {
+    auto& bucket = findBucket(hashOf(key), key);
+    if(0 == bucket.offset){
+        return;
+    }
+    // record is flagged first, so index rebuilt from data after crash doesn't bring the key back
+    recordAt(bucket.offset).flags |= removedFlag;
+    eraseBucket(bucket);
+    if(DbOptions::FsyncPolicy::always == options_.fsyncPolicy){
+        flush();
+    }
+}
+
+
+inline std::uint64_t MappedHashFile::size() const {
+    return indexHeader().usedBuckets;
+}
+
+
+template<typename Visitor>
+void MappedHashFile::forEachKey(Visitor visitor) const {
+    auto table = buckets();
+    for(std::uint64_t bucketIndex = 0; bucketIndex < indexHeader().bucketsCount; ++bucketIndex){
+        if(0 == table[bucketIndex].offset){
+            continue;
+        }
+        auto& record = recordAt(table[bucketIndex].offset);
+        visitor(ByteView{reinterpret_cast<const char*>(&record + 1), record.keySize});
+    }
+}
+
+
+inline void MappedHashFile::flush() {
+    if(DbOptions::FsyncPolicy::none == options_.fsyncPolicy){
+        return;
+    }
+    // data first, so synced index never points to unsynced records
+    syncMapping(data_);
+    syncMapping(index_);
+}
+
+
+inline std::uint64_t MappedHashFile::hashOf(const ByteView& key) {
+    // FNV-1a, stored in the index, so must not change between runs unlike std::hash
+    std::uint64_t hash{14695981039346656037ull};
+    for(std::size_t index = 0; index < key.size; ++index){
+        hash = (hash ^ static_cast<unsigned char>(key.data[index])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+
+inline std::uint64_t MappedHashFile::align(std::uint64_t size) {
+    return (size + recordAlignment - 1) / recordAlignment * recordAlignment;
+}
+
+
+inline std::uint64_t MappedHashFile::indexSize(std::uint64_t bucketsCount) {
+    return align(sizeof(IndexHeader)) + bucketsCount * sizeof(Bucket);
+}
+
+
+inline bool MappedHashFile::openMapping(Mapping& mapping, const std::string& fileName, std::uint64_t initialSize) {
+    mapping.fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if(mapping.fd < 0){
+        throwIoError("open", fileName);
+    }
+    struct stat fileStat;
+    if(0 != ::fstat(mapping.fd, &fileStat)){
+        throwIoError("stat", fileName);
+    }
+    bool created = 0 == fileStat.st_size;
+    if(created){
+        // ftruncate fills file with zeros, so all buckets are empty
+        if(0 != ::ftruncate(mapping.fd, initialSize)){
+            throwIoError("truncate", fileName);
+        }
+        mapping.size = initialSize;
+    } else {
+        mapping.size = static_cast<std::uint64_t>(fileStat.st_size);
+    }
+    void* data = ::mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.fd, 0);
+    if(MAP_FAILED == data){
+        throwIoError("mmap", fileName);
+    }
+    mapping.data = static_cast<char*>(data);
+    return created;
+}
+
+
+inline void MappedHashFile::closeMapping(Mapping& mapping) {
+    if(nullptr != mapping.data){
+        ::munmap(mapping.data, mapping.size);
+        mapping.data = nullptr;
+    }
+    if(mapping.fd >= 0){
+        ::close(mapping.fd);
+        mapping.fd = -1;
+    }
+}
+
+
+inline void MappedHashFile::resizeMapping(Mapping& mapping, std::uint64_t newSize) {
+    // mapping only grows, so old one stays valid over the grown file and is unmapped only once the new one is
+    // in place, failed resize leaves the file readable and writable as it was
+    if(0 != ::ftruncate(mapping.fd, newSize)){
+        throwIoError("truncate", fileName_);
+    }
+    void* data = ::mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.fd, 0);
+    if(MAP_FAILED == data){
+        // grown tail of the file is past dataEnd, so it's just unused
+        throwIoError("mmap", fileName_);
+    }
+    ::munmap(mapping.data, mapping.size);
+    mapping.data = static_cast<char*>(data);
+    mapping.size = newSize;
+}
+
+
+inline void MappedHashFile::syncMapping(Mapping& mapping) {
+    if(0 != ::msync(mapping.data, mapping.size, MS_SYNC)){
+        throwIoError("msync", fileName_);
+    }
+}
+
+
+inline void MappedHashFile::initIndex(Mapping& mapping, std::uint64_t bucketsCount) {
+    auto& header = *reinterpret_cast<IndexHeader*>(mapping.data);
+    header.magic = indexMagic;
+    header.bucketsCount = bucketsCount;
+    header.usedBuckets = 0;
+}
+
+
+inline bool MappedHashFile::indexValid() const {
+    if(index_.size < align(sizeof(IndexHeader)) || indexMagic != indexHeader().magic){
+        return false;
+    }
+    auto bucketsCount = indexHeader().bucketsCount;
+    if(0 == bucketsCount || 0 != (bucketsCount & (bucketsCount - 1)) || index_.size != indexSize(bucketsCount)){
+        return false;
+    }
+    auto table = buckets();
+    std::uint64_t usedBuckets{0};
+    for(std::uint64_t bucketIndex = 0; bucketIndex < bucketsCount; ++bucketIndex){
+        auto offset = table[bucketIndex].offset;
+        if(0 == offset){
+            continue;
+        }
+        if(offset < align(sizeof(DataHeader)) || 0 != offset % recordAlignment ||
+           offset + sizeof(RecordHeader) > dataHeader().dataEnd){
+            return false;
+        }
+        ++usedBuckets;
+    }
+    return usedBuckets == indexHeader().usedBuckets;
+}
+
+
+inline const MappedHashFile::IndexHeader& MappedHashFile::indexHeader() const {
+    return *reinterpret_cast<const IndexHeader*>(index_.data);
+}
+
+
+inline MappedHashFile::IndexHeader& MappedHashFile::indexHeader() {
+    return *reinterpret_cast<IndexHeader*>(index_.data);
+}
+
+
+inline MappedHashFile::Bucket* MappedHashFile::buckets() const {
+    return reinterpret_cast<Bucket*>(index_.data + align(sizeof(IndexHeader)));
+}
+
+
+inline MappedHashFile::DataHeader& MappedHashFile::dataHeader() const {
+    return *reinterpret_cast<DataHeader*>(data_.data);
+}
+
+
+inline MappedHashFile::RecordHeader& MappedHashFile::recordAt(std::uint64_t offset) const {
+    return *reinterpret_cast<RecordHeader*>(data_.data + offset);
+}
+
+
+inline MappedHashFile::Bucket& MappedHashFile::findBucket(std::uint64_t hash, const ByteView& key) const {
+    auto mask = indexHeader().bucketsCount - 1;
+    auto table = buckets();
+    // load factor is kept below 100%, so probing always meets an empty bucket
+    for(auto bucketIndex = hash & mask; ; bucketIndex = (bucketIndex + 1) & mask){
+        auto& bucket = table[bucketIndex];
+        if(0 == bucket.offset){
+            return bucket;
+        }
+        if(hash == bucket.hash){
+            auto& record = recordAt(bucket.offset);
+            if(record.keySize == key.size &&
+               0 == std::memcmp(reinterpret_cast<const char*>(&record + 1), key.data, key.size)){
+                return bucket;
+            }
+        }
+    }
+}
+
+
+inline std::uint64_t MappedHashFile::appendRecord(const ByteView& key, const ByteView& value) {
+    auto valueCapacity = align(value.size);
+    auto recordSize = align(sizeof(RecordHeader) + key.size + valueCapacity);
+    auto offset = dataHeader().dataEnd;
+    if(offset + recordSize > data_.size){
+        resizeMapping(data_, std::max(2 * data_.size, offset + recordSize));
+    }
+
+    auto& record = recordAt(offset);
+    record.keySize = static_cast<std::uint32_t>(key.size);
+    record.valueCapacity = static_cast<std::uint32_t>(valueCapacity);
+    record.valueSize = static_cast<std::uint32_t>(value.size);
+    record.flags = 0;
+    std::memcpy(reinterpret_cast<char*>(&record + 1), key.data, key.size);
+    std::memcpy(reinterpret_cast<char*>(&record + 1) + key.size, value.data, value.size);
+    dataHeader().dataEnd = offset + recordSize;
+    return offset;
+}
+
+
+inline void MappedHashFile::eraseBucket(Bucket& bucket) {
+    auto mask = indexHeader().bucketsCount - 1;
+    auto table = buckets();
+    auto holeIndex = static_cast<std::uint64_t>(&bucket - table);
+    // backward shift: entry of the run moves into the hole, unless the hole is before its home bucket, then the
+    // run continues past it; run ends at empty bucket
+    for(auto bucketIndex = (holeIndex + 1) & mask; 0 != table[bucketIndex].offset;
+        bucketIndex = (bucketIndex + 1) & mask){
+        auto homeIndex = table[bucketIndex].hash & mask;
+        if(((bucketIndex - homeIndex) & mask) >= ((bucketIndex - holeIndex) & mask)){
+            table[holeIndex] = table[bucketIndex];
+            holeIndex = bucketIndex;
+        }
+    }
+    table[holeIndex].hash = 0;
+    table[holeIndex].offset = 0;
+    --indexHeader().usedBuckets;
+}
+
+
+inline void MappedHashFile::rehash() {
+    // new index is built aside and renamed over the old one, so crash during rehash leaves old index intact
+    const std::string rehashedName{indexFileName_ + ".rehash"};
+    ::unlink(rehashedName.c_str());
+    auto bucketsCount = 2 * indexHeader().bucketsCount;
+    Mapping rehashed;
+    try{
+        openMapping(rehashed, rehashedName, indexSize(bucketsCount));
+        initIndex(rehashed, bucketsCount);
+        auto newTable = reinterpret_cast<Bucket*>(rehashed.data + align(sizeof(IndexHeader)));
+        auto oldTable = buckets();
+        auto mask = bucketsCount - 1;
+        for(std::uint64_t bucketIndex = 0; bucketIndex < indexHeader().bucketsCount; ++bucketIndex){
+            if(0 == oldTable[bucketIndex].offset){
+                continue;
+            }
+            // keys are unique, so there is no need to compare them, first empty bucket is the place
+            auto newIndex = oldTable[bucketIndex].hash & mask;
+            while(0 != newTable[newIndex].offset){
+                newIndex = (newIndex + 1) & mask;
+            }
+            newTable[newIndex] = oldTable[bucketIndex];
+        }
+        reinterpret_cast<IndexHeader*>(rehashed.data)->usedBuckets = indexHeader().usedBuckets;
+        if(DbOptions::FsyncPolicy::none != options_.fsyncPolicy){
+            syncMapping(rehashed);
+        }
+        if(0 != std::rename(rehashedName.c_str(), indexFileName_.c_str())){
+            throwIoError("rename", rehashedName);
+        }
+    } catch(...){
+        closeMapping(rehashed);
+        ::unlink(rehashedName.c_str());
+        throw;
+    }
+    closeMapping(index_);
+    index_ = rehashed;
+}
+
+
+inline void MappedHashFile::rebuildIndex() {
+    for(auto offset = align(sizeof(DataHeader)); offset < dataHeader().dataEnd; ){
+        auto& record = recordAt(offset);
+        const ByteView key{reinterpret_cast<const char*>(&record + 1), record.keySize};
+        if((indexHeader().usedBuckets + 1) * 100 > indexHeader().bucketsCount * maxLoadPercent){
+            rehash();
+        }
+        auto hash = hashOf(key);
+        auto& bucket = findBucket(hash, key);
+        if(0 != (record.flags & removedFlag)){
+            // the key was removed after this record and all earlier ones, later record may bring it back
+            if(0 != bucket.offset){
+                eraseBucket(bucket);
+            }
+        } else {
+            if(0 == bucket.offset){
+                ++indexHeader().usedBuckets;
+            }
+            bucket.hash = hash;
+            bucket.offset = offset;
+        }
+        offset += align(sizeof(RecordHeader) + record.keySize + record.valueCapacity);
+    }
+}
+
+
+inline void MappedHashFile::throwIoError(const char* operation, const std::string& fileName) {
+    throw DbIoException(std::string{"Mapped hash db "} + operation + " failed for " + fileName + ": " +
+                        std::strerror(errno));
+}
+
+
+} // namespace
+#endif // MAPPED_HASH_FILE_H
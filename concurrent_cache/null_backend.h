@@ -0,0 +1,50 @@
+#ifndef NULL_BACKEND_H
+#define NULL_BACKEND_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "boost/noncopyable.hpp"
+#include "cache_options.h"
+
+namespace concurrent_cache{
+
+
+// backend which stores nothing, for pure caching: misses find no value, updates live in the cache only and are
+// lost once evicted. It's also the reference of what ConcurrentCache needs from Backend; calls are serialized by
+// the cache, so backend needn't be thread safe
+template<typename Key, typename Value>
+class NullBackend : private boost::noncopyable {
+    public:
+        // path and options are the ones of CacheOptions::db, path resolved to default file name if empty
+        NullBackend(const std::string&, const DbOptions&){}
+
+        void update(const Key&, const Value&){}
+        // records are applied in order
+        void updateMany(const std::vector<std::pair<Key, Value>>&){}
+        // no-op if there is no such key; ConcurrentCache::remove calls it after the key left the cache
+        void remove(const Key&){}
+        // returns false if there is no such key, value is left untouched then
+        bool find(const Key&, Value&){
+            return false;
+        }
+        // values and found flags of keys in the same order, value of missing key is default one
+        void findMany(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found){
+            values.assign(keys.size(), Value());
+            found.assign(keys.size(), false);
+        }
+        // count of keys, sizes presence filter
+        std::uint64_t size(){
+            return 0;
+        }
+        // calls visitor(key) for every key, fills presence filter
+        template<typename Visitor>
+        void forEachKey(Visitor){}
+        // persist updates made so far, called once per sync pass
+        void flush(){}
+};
+
+
+} // namespace
+#endif // NULL_BACKEND_H
@@ -0,0 +1,87 @@
+#ifndef PRESENCE_FILTER_H
+#define PRESENCE_FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include "boost/noncopyable.hpp"
+
+
+namespace concurrent_cache{
+
+
+// bloom filter of key hashes, tells keys which were never added from keys which may have been added.
+// Keys are added by many threads without locks; bits are never cleared, false positive rate grows once
+// more keys than capacity are added
+class PresenceFilter : boost::noncopyable  {
+    public:
+        PresenceFilter(std::uint64_t capacity, unsigned int bitsPerKey);
+        void add(std::uint64_t hash);
+        bool mayContain(std::uint64_t hash) const;
+
+    private:
+        static const std::uint64_t minBitsCount = 64;
+        static const unsigned int maxProbesCount = 16;
+
+        static std::uint64_t mix(std::uint64_t hash);
+
+        std::uint64_t mask_;
+        unsigned int probesCount_;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> words_;
+};
+
+
+inline PresenceFilter::PresenceFilter(std::uint64_t capacity, unsigned int bitsPerKey)
+    :probesCount_{static_cast<unsigned int>(std::min<double>(maxProbesCount,
+                                                             std::max(1.0, std::round(bitsPerKey * std::log(2.0)))))}{
+    std::uint64_t bitsCount{minBitsCount};
+    while(bitsCount < capacity * bitsPerKey){
+        bitsCount <<= 1;
+    }
+    mask_ = bitsCount - 1;
+    words_.reset(new std::atomic<std::uint64_t>[bitsCount / 64]);
+    for(std::uint64_t wordIndex = 0; wordIndex < bitsCount / 64; ++wordIndex){
+        words_[wordIndex].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+inline void PresenceFilter::add(std::uint64_t hash) {
+    // probes are derived from two halves of mixed hash (double hashing)
+    auto mixed = mix(hash);
+    auto step = (mixed >> 32) | 1;
+    for(unsigned int probe = 0; probe < probesCount_; ++probe){
+        auto bit = (mixed + probe * step) & mask_;
+        words_[bit / 64].fetch_or(1ull << (bit % 64), std::memory_order_relaxed);
+    }
+}
+
+
+inline bool PresenceFilter::mayContain(std::uint64_t hash) const {
+    auto mixed = mix(hash);
+    auto step = (mixed >> 32) | 1;
+    for(unsigned int probe = 0; probe < probesCount_; ++probe){
+        auto bit = (mixed + probe * step) & mask_;
+        if(0 == (words_[bit / 64].load(std::memory_order_relaxed) & (1ull << (bit % 64)))){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+inline std::uint64_t PresenceFilter::mix(std::uint64_t hash) {
+    // identity hashes of integers would set neighbouring bits otherwise
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+
+} // namespace
+#endif // PRESENCE_FILTER_H
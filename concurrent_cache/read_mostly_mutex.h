@@ -0,0 +1,200 @@
+#ifndef READ_MOSTLY_MUTEX_H
+#define READ_MOSTLY_MUTEX_H
+
+#include <atomic>
+#include <cstdint>
+#include "boost/noncopyable.hpp"
+#include "boost/chrono.hpp"
+#include "boost/thread/mutex.hpp"
+#include "backoff.h"
+#include "thread_slots.h"
+
+
+namespace concurrent_cache{
+
+
+// shared mutex for read dominated workloads: reader registers itself in the counter of its own thread slot,
+// so readers on different cores don't write the same cache line, unlike boost::shared_mutex which takes
+// internal mutex on every lock_shared. Writer raises the flag, which sends new readers to wait, and waits
+// until all slots drain, so writers are preferred and writer lock is more expensive (scans all slots).
+// Waiters back off (spin, yield, then sleep), see Backoff.
+// Meets boost Lockable/SharedLockable requirements, timed methods take boost::chrono durations as
+// boost::unique_lock and boost::shared_lock pass them
+class ReadMostlySharedMutex : boost::noncopyable  {
+    public:
+        ReadMostlySharedMutex();
+
+        void lock_shared();
+        bool try_lock_shared();
+        template<typename Rep, typename Period>
+        bool try_lock_shared_for(const boost::chrono::duration<Rep, Period>& timeout);
+        void unlock_shared();
+
+        void lock();
+        bool try_lock();
+        template<typename Rep, typename Period>
+        bool try_lock_for(const boost::chrono::duration<Rep, Period>& timeout);
+        void unlock();
+
+        // converts shared ownership of the caller to exclusive one without letting another writer in between, so
+        // whatever caller read under shared lock stays valid. Fails at once if another writer or upgrader holds or
+        // waits for the lock (two upgraders would wait for each other), or if other readers don't leave within
+        // timeout; caller keeps shared ownership then
+        template<typename Rep, typename Period>
+        bool try_unlock_shared_and_lock_for(const boost::chrono::duration<Rep, Period>& timeout);
+
+    private:
+        // padded to cache line, see StripedCounter
+        struct ReaderSlot{
+                std::atomic<std::uint32_t> readers{0};
+                char padding[cacheLineSize - sizeof(std::atomic<std::uint32_t>)];
+        };
+
+        bool readersDrained() const;
+
+        ReaderSlot readerSlots_[threadSlotsCount];
+        // last reader slot padding keeps it off readers counters line
+        std::atomic<bool> writerActive_;
+        // serializes writers, readers never touch it
+        boost::timed_mutex writerMtx_;
+};
+
+
+inline ReadMostlySharedMutex::ReadMostlySharedMutex()
+    :writerActive_{false}{
+}
+
+
+inline void ReadMostlySharedMutex::lock_shared() {
+    Backoff backoff;
+    while(!try_lock_shared()){
+        backoff.pause();
+    }
+}
+
+
+inline bool ReadMostlySharedMutex::try_lock_shared() {
+    if(writerActive_.load(std::memory_order_relaxed)){
+        return false;
+    }
+    auto& slot = readerSlots_[threadSlot()];
+    // reader publishes itself, then checks writer flag, writer does the opposite, seq_cst on both sides
+    // guarantees that at least one of them sees the other
+    slot.readers.fetch_add(1, std::memory_order_seq_cst);
+    if(writerActive_.load(std::memory_order_seq_cst)){
+        slot.readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+
+template<typename Rep, typename Period>
+bool ReadMostlySharedMutex::try_lock_shared_for(const boost::chrono::duration<Rep, Period>& timeout) {
+    // uncontended lock doesn't read the clock
+    if(try_lock_shared()){
+        return true;
+    }
+    auto deadline = boost::chrono::steady_clock::now() + timeout;
+    Backoff backoff;
+    while(!try_lock_shared()){
+        if(boost::chrono::steady_clock::now() >= deadline){
+            return false;
+        }
+        backoff.pause();
+    }
+    return true;
+}
+
+
+inline void ReadMostlySharedMutex::unlock_shared() {
+    readerSlots_[threadSlot()].readers.fetch_sub(1, std::memory_order_release);
+}
+
+
+inline void ReadMostlySharedMutex::lock() {
+    writerMtx_.lock();
+    writerActive_.store(true, std::memory_order_seq_cst);
+    Backoff backoff;
+    while(!readersDrained()){
+        backoff.pause();
+    }
+}
+
+
+inline bool ReadMostlySharedMutex::try_lock() {
+    if(!writerMtx_.try_lock()){
+        return false;
+    }
+    writerActive_.store(true, std::memory_order_seq_cst);
+    if(!readersDrained()){
+        writerActive_.store(false, std::memory_order_release);
+        writerMtx_.unlock();
+        return false;
+    }
+    return true;
+}
+
+
+template<typename Rep, typename Period>
+bool ReadMostlySharedMutex::try_lock_for(const boost::chrono::duration<Rep, Period>& timeout) {
+    auto deadline = boost::chrono::steady_clock::now() + timeout;
+    if(!writerMtx_.try_lock_until(deadline)){
+        return false;
+    }
+    writerActive_.store(true, std::memory_order_seq_cst);
+    Backoff backoff;
+    while(!readersDrained()){
+        if(boost::chrono::steady_clock::now() >= deadline){
+            writerActive_.store(false, std::memory_order_release);
+            writerMtx_.unlock();
+            return false;
+        }
+        backoff.pause();
+    }
+    return true;
+}
+
+
+inline void ReadMostlySharedMutex::unlock() {
+    writerActive_.store(false, std::memory_order_release);
+    writerMtx_.unlock();
+}
+
+
+template<typename Rep, typename Period>
+bool ReadMostlySharedMutex::try_unlock_shared_and_lock_for(const boost::chrono::duration<Rep, Period>& timeout) {
+    if(!writerMtx_.try_lock()){
+        return false;
+    }
+    auto deadline = boost::chrono::steady_clock::now() + timeout;
+    writerActive_.store(true, std::memory_order_seq_cst);
+    // no writer can come in while writer mutex is held, so dropping own reader count loses nothing
+    auto& slot = readerSlots_[threadSlot()];
+    slot.readers.fetch_sub(1, std::memory_order_seq_cst);
+    Backoff backoff;
+    while(!readersDrained()){
+        if(boost::chrono::steady_clock::now() >= deadline){
+            slot.readers.fetch_add(1, std::memory_order_seq_cst);
+            writerActive_.store(false, std::memory_order_release);
+            writerMtx_.unlock();
+            return false;
+        }
+        backoff.pause();
+    }
+    return true;
+}
+
+
+inline bool ReadMostlySharedMutex::readersDrained() const {
+    for(const auto& slot : readerSlots_){
+        if(0 != slot.readers.load(std::memory_order_seq_cst)){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+} // namespace
+#endif // READ_MOSTLY_MUTEX_H
@@ -1,8 +1,12 @@
 #ifndef RECORD_LIFETIME_MANAGER_H
 #define RECORD_LIFETIME_MANAGER_H
 
+#include <cstdint>
 #include <queue>
+#include <unordered_map>
 #include <memory>
+#include <functional>
+#include <utility>
 #include "boost/noncopyable.hpp"
 #include "cache_exceptions.h"
 
@@ -10,17 +14,62 @@
 namespace concurrent_cache{
 
 
+// lifetime managers which need to find record again (on hit) use RecordTraits to identify it: plain records
+// are identified by value, cache records by handle. Hash is stable over the logical key and may be used after
+// record is removed (ghost entries, frequency sketches)
+template<typename Record>
+struct RecordTraits{
+        typedef Record Id;
+        static const Id& id(const Record& record){
+            return record;
+        }
+        static std::size_t hash(const Record& record){
+            return std::hash<Record>()(record);
+        }
+};
+
+
+// cache passes its records to lifetime managers by handle of the entry in shard table, which stays valid while
+// the table moves entries, with the key hash made by cache Hasher, so keys needn't have std::hash
+struct RecordHandle{
+        std::uint32_t id;
+        std::uint32_t keyHash;
+};
+
+
+template<>
+struct RecordTraits<RecordHandle>{
+        typedef std::uint32_t Id;
+        static Id id(const RecordHandle& record){
+            return record.id;
+        }
+        static std::size_t hash(const RecordHandle& record){
+            return record.keyHash;
+        }
+};
+
+
 template<typename Record>
 class CacheRecordLifetimeManager : boost::noncopyable  {
     public:
         CacheRecordLifetimeManager() = default;
         void addRecord(const Record& record);
+        // called on every cache hit, may be called concurrently from many threads (but never concurrently
+        // with addRecord/getRecordToRemove)
+        void touch(const Record& record);
         // use shared_ptr to provide exception safety keeping in mind Record copy constructors can rise such
         std::shared_ptr<Record> getRecordToRemove();
+        // record leaves the cache other way than eviction (e.g. expires), record must be managed
+        void removeRecord(const Record& record);
 
     private:
+        typedef RecordTraits<Record> Traits;
+
         // simple FIFO
         std::queue<Record> queue_;
+        // removed records stay in the queue until they reach its front, counted by id, since the same id may
+        // be added again after removal (its older queue item is always ahead of the newer one)
+        std::unordered_map<typename Traits::Id, std::size_t> removed_;
 };
 
 
@@ -30,8 +79,24 @@ void CacheRecordLifetimeManager<Record>::addRecord(const Record& record) {
 }
 
 
+template<typename Record>
+void CacheRecordLifetimeManager<Record>::touch(const Record&) {
+    // FIFO doesn't care about hits
+}
+
+
 template<typename Record>
 std::shared_ptr<Record> CacheRecordLifetimeManager<Record>::getRecordToRemove(){
+    while(!queue_.empty()){
+        auto removedFound = removed_.find(Traits::id(queue_.front()));
+        if(std::end(removed_) == removedFound){
+            break;
+        }
+        if(0 == --(*removedFound).second){
+            removed_.erase(removedFound);
+        }
+        queue_.pop();
+    }
     if(queue_.empty()){
         throw QueueEmpty();
     }
@@ -42,5 +107,11 @@ std::shared_ptr<Record> CacheRecordLifetimeManager<Record>::getRecordToRemove(){
 }
 
 
+template<typename Record>
+void CacheRecordLifetimeManager<Record>::removeRecord(const Record& record){
+    ++removed_[Traits::id(record)];
+}
+
+
 } // namespace
 #endif // RECORD_LIFETIME_MANAGER_H
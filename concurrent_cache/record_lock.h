@@ -0,0 +1,88 @@
+#ifndef RECORD_LOCK_H
+#define RECORD_LOCK_H
+
+#include <atomic>
+#include "boost/noncopyable.hpp"
+#include "boost/chrono.hpp"
+#include "backoff.h"
+
+
+namespace concurrent_cache{
+
+
+// one byte lock embedded in every cache record. Record writers hold it for a value copy only, so waiter
+// spins briefly, expecting the owner to finish soon, then backs off between attempts, see Backoff.
+// Meets boost Lockable requirements, try_lock_for takes boost::chrono duration as boost::unique_lock passes it
+class RecordLock : boost::noncopyable  {
+    public:
+        RecordLock()
+            :locked_{false}{}
+
+        void lock();
+        bool try_lock();
+        template<typename Rep, typename Period>
+        bool try_lock_for(const boost::chrono::duration<Rep, Period>& timeout);
+        void unlock();
+
+    private:
+        static const int spinsCount = 64;
+
+        // spin on plain load, so waiters don't bounce the cache line with failed exchanges
+        bool spinUntilFree() const;
+
+        std::atomic<bool> locked_;
+};
+
+
+inline void RecordLock::lock() {
+    Backoff backoff;
+    while(!try_lock()){
+        if(!spinUntilFree()){
+            backoff.pause();
+        }
+    }
+}
+
+
+inline bool RecordLock::try_lock() {
+    return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+}
+
+
+template<typename Rep, typename Period>
+bool RecordLock::try_lock_for(const boost::chrono::duration<Rep, Period>& timeout) {
+    if(try_lock()){
+        return true;
+    }
+    auto deadline = boost::chrono::steady_clock::now() + timeout;
+    Backoff backoff;
+    while(!try_lock()){
+        if(boost::chrono::steady_clock::now() >= deadline){
+            return false;
+        }
+        if(!spinUntilFree()){
+            backoff.pause();
+        }
+    }
+    return true;
+}
+
+
+inline void RecordLock::unlock() {
+    locked_.store(false, std::memory_order_release);
+}
+
+
+inline bool RecordLock::spinUntilFree() const {
+    for(int spin = 0; spin < spinsCount; ++spin){
+        if(!locked_.load(std::memory_order_relaxed)){
+            return true;
+        }
+        cpuRelax();
+    }
+    return false;
+}
+
+
+} // namespace
+#endif // RECORD_LOCK_H
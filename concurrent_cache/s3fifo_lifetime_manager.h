@@ -0,0 +1,180 @@
+#ifndef S3FIFO_LIFETIME_MANAGER_H
+#define S3FIFO_LIFETIME_MANAGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "record_lifetime_manager.h"
+
+
+namespace concurrent_cache{
+
+
+// S3-FIFO: new records go to small FIFO queue (10% of records), those which were hit there are moved to main
+// FIFO queue, others are evicted quickly and remembered in ghost queue, so they go straight to main queue if
+// requested again soon. Main queue gives a second chance (up to 3) to records hit since the last visit.
+// Hits only increment atomic frequency counter, no lock is taken
+template<typename Record>
+class S3FifoRecordLifetimeManager : boost::noncopyable  {
+    public:
+        S3FifoRecordLifetimeManager() = default;
+        void addRecord(const Record& record);
+        void touch(const Record& record);
+        std::shared_ptr<Record> getRecordToRemove();
+        // record leaves the cache other way than eviction (e.g. expires), record must be managed
+        void removeRecord(const Record& record);
+
+    private:
+        typedef RecordTraits<Record> Traits;
+
+        static const std::uint8_t maxFrequency = 3;
+        static const std::size_t smallQueuePercent = 10;
+
+        struct Entry{
+                Record record;
+                std::atomic<std::uint8_t> frequency;
+                bool inMain;
+                Entry(const Record& rec, bool main)
+                    :record(rec),
+                     frequency{0},
+                     inMain{main}{}
+        };
+        typedef typename std::list<Entry>::iterator Position;
+
+        void addGhost(std::size_t hash);
+        bool removeGhost(std::size_t hash);
+        std::shared_ptr<Record> removeEntry(Position position);
+
+        std::list<Entry> small_;
+        std::list<Entry> main_;
+        // touch only reads this map, it's modified under cache exclusive lock only
+        std::unordered_map<typename Traits::Id, Position> positions_;
+
+        // hashes of records recently evicted from small queue, bounded by count of managed records; deque keeps
+        // insertion order, index keeps the latest insertion of each hash, so stale deque items are skipped
+        std::deque<std::pair<std::size_t, std::uint64_t>> ghost_;
+        std::unordered_map<std::size_t, std::uint64_t> ghostIndex_;
+        std::uint64_t ghostSequence_{0};
+};
+
+
+template<typename Record>
+void S3FifoRecordLifetimeManager<Record>::addRecord(const Record& record) {
+    auto hash = Traits::hash(record);
+    auto& queue = ghostIndex_.count(hash) ? main_ : small_;
+    auto position = queue.emplace(std::end(queue), record, &queue == &main_);
+    try{
+        if(!positions_.emplace(Traits::id(record), position).second){
+            queue.erase(position);
+            this->touch(record);
+            return;
+        }
+    } catch(...){
+        queue.erase(position);
+        throw;
+    }
+    if((*position).inMain){
+        removeGhost(hash);
+    }
+}
+
+
+template<typename Record>
+void S3FifoRecordLifetimeManager<Record>::touch(const Record& record) {
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) == positionFound){
+        return;
+    }
+    auto& frequency = (*(*positionFound).second).frequency;
+    auto current = frequency.load(std::memory_order_relaxed);
+    while(current < maxFrequency &&
+          !frequency.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)){
+    }
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> S3FifoRecordLifetimeManager<Record>::getRecordToRemove(){
+    if(positions_.empty()){
+        throw QueueEmpty();
+    }
+
+    while(1){
+        auto smallTarget = std::max<std::size_t>(1, positions_.size() * smallQueuePercent / 100);
+        if(!small_.empty() && (small_.size() >= smallTarget || main_.empty())){
+            auto position = std::begin(small_);
+            if((*position).frequency.load(std::memory_order_relaxed) > 0){
+                // hit while in small queue, worth keeping
+                (*position).frequency.store(0, std::memory_order_relaxed);
+                (*position).inMain = true;
+                main_.splice(std::end(main_), small_, position);
+                continue;
+            }
+            addGhost(Traits::hash((*position).record));
+            return removeEntry(position);
+        }
+
+        auto position = std::begin(main_);
+        auto frequency = (*position).frequency.load(std::memory_order_relaxed);
+        if(frequency > 0){
+            (*position).frequency.store(frequency - 1, std::memory_order_relaxed);
+            main_.splice(std::end(main_), main_, position);
+            continue;
+        }
+        return removeEntry(position);
+    }
+}
+
+
+template<typename Record>
+void S3FifoRecordLifetimeManager<Record>::removeRecord(const Record& record){
+    // removed not by the policy, so it isn't remembered as ghost
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        this->removeEntry((*positionFound).second);
+    }
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> S3FifoRecordLifetimeManager<Record>::removeEntry(Position position){
+    std::shared_ptr<Record> recordToRemove{std::make_shared<Record>((*position).record)};
+    positions_.erase(Traits::id((*position).record));
+    if((*position).inMain){
+        main_.erase(position);
+    } else {
+        small_.erase(position);
+    }
+    return recordToRemove;
+}
+
+
+template<typename Record>
+void S3FifoRecordLifetimeManager<Record>::addGhost(std::size_t hash){
+    ghost_.emplace_back(hash, ++ghostSequence_);
+    ghostIndex_[hash] = ghostSequence_;
+    while(ghost_.size() > positions_.size()){
+        auto indexFound = ghostIndex_.find(ghost_.front().first);
+        if(std::end(ghostIndex_) != indexFound && (*indexFound).second == ghost_.front().second){
+            ghostIndex_.erase(indexFound);
+        }
+        ghost_.pop_front();
+    }
+}
+
+
+template<typename Record>
+bool S3FifoRecordLifetimeManager<Record>::removeGhost(std::size_t hash){
+    // deque item stays until it ages out, it doesn't match the index anymore
+    return 0 != ghostIndex_.erase(hash);
+}
+
+
+} // namespace
+#endif // S3FIFO_LIFETIME_MANAGER_H
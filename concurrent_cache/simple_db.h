@@ -1,24 +1,57 @@
 #ifndef SIMPLE_DB_H
 #define SIMPLE_DB_H
 
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 #include "boost/noncopyable.hpp"
 #include "string_conv.h"
+#include "codec.h"
 #include "json/json.h"
+#include "append_log.h"
+#include "mapped_hash_file.h"
 #include "cache_exceptions.h"
+#include "cache_options.h"
 
 namespace concurrent_cache{
 
+// options.format selects how records are stored: in memory with json dump on flush (if modified) and on shutdown
+// or append-only log written as records are updated, or in memory mapped hash table file read lazily. Json is text, keys and
+// values are converted by toString/fromString there, binary formats encode them with Codec
 template<typename Key, typename Value>
 class SimpleDB : private boost::noncopyable {
     public:
-        SimpleDB(const std::string& dbFileName);
+        SimpleDB(const std::string& dbFileName, const DbOptions& options = DbOptions());
         ~SimpleDB();
 
         void update(const Key& key, const Value& value);
+        // records are applied in order
+        void updateMany(const std::vector<std::pair<Key, Value>>& records);
+        // no-op if there is no such key
+        void remove(const Key& key);
+        // default value if there is no such key
         Value find(const Key& key);
+        // returns false if there is no such key, value is left untouched then
+        bool find(const Key& key, Value& value);
+        // values and found flags of keys in the same order, value of missing key is default one
+        void findMany(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found);
+        // count of keys
+        std::uint64_t size();
+        // calls visitor(key) for every key
+        template<typename Visitor>
+        void forEachKey(Visitor visitor);
+        // persist updates made so far; json is dumped as a whole, so flush of modified json db costs a write of
+        // all its records
+        void flush();
 
     private:
 
@@ -31,18 +64,34 @@ class SimpleDB : private boost::noncopyable {
         void initDb();
         void createNewDbDumpFile();
         void loadDbFromDump(std::fstream& dumpFile);
+        void loadDbFromLog();
+        void applyRecord(const Key& key, const Value& value);
+        // writes json aside and renames it over the dump, so crash leaves either old or new dump whole
+        void dumpJson();
         std::string dbFileName_;
+        DbOptions options_;
 
         Json::Value db_;
         std::unique_ptr<Json::Writer> writer_;
+        // json records changed since last dump
+        bool jsonModified_;
+        std::unique_ptr<AppendLog> log_;
+        // in memory copy of the log
+        std::unordered_map<Key, Value> records_;
+        std::unique_ptr<MappedHashFile> table_;
+        // size of the log if it had latest record of each key only, used to decide on compaction
+        std::uint64_t liveLogSize_;
 };
 
 
 template<typename Key, typename Value>
-SimpleDB<Key, Value>::SimpleDB(const std::string& dbFileName)
+SimpleDB<Key, Value>::SimpleDB(const std::string& dbFileName, const DbOptions& options)
     :dbInited_{false},
      dbFileName_{dbFileName},
-     writer_{new Json::StyledWriter}{
+     options_(options),
+     writer_{new Json::StyledWriter},
+     jsonModified_{false},
+     liveLogSize_{0}{
     initDb();
 }
 
@@ -50,11 +99,12 @@ SimpleDB<Key, Value>::SimpleDB(const std::string& dbFileName)
 template<typename Key, typename Value>
 SimpleDB<Key, Value>::~SimpleDB() {
     try{
-        if(dbInited_){
-            std::fstream  dbDumpFile;
-            dbDumpFile.open(dbFileName_, std::ios::out | std::ios::trunc);
-            dbDumpFile << writer_->write(db_);
-            // std::cout << "dump to file: " << writer_->write(db_) << std::endl;
+        if(dbInited_ && log_){
+            log_->flush();
+        } else if(dbInited_ && table_){
+            table_->flush();
+        } else if(dbInited_){
+            this->dumpJson();
         }
     } catch (const std::exception& ex){
         std::cerr << ex.what() << std::endl; // log somewhere
@@ -66,20 +116,166 @@ SimpleDB<Key, Value>::~SimpleDB() {
 
 template<typename Key, typename Value>
 void SimpleDB<Key, Value>::update(const Key& key, const Value& value) {
-    db_[this->rootKeyName()][toString(key)] =  toString(value);
+    if(table_){
+        table_->update(Encoded<Key>{key}.view(), Encoded<Value>{value}.view());
+    } else if(log_){
+        // append only buffers the record (unless the batch is full or policy is always), so its write error may
+        // come from a later flush as well; in memory value is applied once the record is buffered, never ahead of it
+        log_->append(Encoded<Key>{key}.view(), Encoded<Value>{value}.view());
+        this->applyRecord(key, value);
+    } else {
+        db_[this->rootKeyName()][toString(key)] =  toString(value);
+        jsonModified_ = true;
+    }
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::updateMany(const std::vector<std::pair<Key, Value>>& records) {
+    for(const auto& record : records){
+        this->update(record.first, record.second);
+    }
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::remove(const Key& key) {
+    if(table_){
+        table_->remove(Encoded<Key>{key}.view());
+    } else if(log_){
+        auto recordFound = records_.find(key);
+        if(records_.end() == recordFound){
+            return;
+        }
+        // removal record is needed till compaction drops the records it overrides
+        log_->appendRemoval(Encoded<Key>{key}.view());
+        liveLogSize_ -= AppendLog::recordSize(Codec<Key>::size(key), Codec<Value>::size((*recordFound).second));
+        records_.erase(recordFound);
+    } else {
+        db_[this->rootKeyName()].removeMember(toString(key));
+        jsonModified_ = true;
+    }
 }
 
 
 template<typename Key, typename Value>
 Value SimpleDB<Key, Value>::find(const Key& key) {
-    Value val;
-    fromString(db_[this->rootKeyName()][toString(key)].asString(), val);
+    Value val{};
+    this->find(key, val);
     return val;
 }
 
 
+template<typename Key, typename Value>
+bool SimpleDB<Key, Value>::find(const Key& key, Value& value) {
+    if(table_){
+        ByteView valueBytes;
+        if(!table_->find(Encoded<Key>{key}.view(), valueBytes)){
+            return false;
+        }
+        decode(valueBytes, value);
+    } else if(log_){
+        auto recordFound = records_.find(key);
+        if(records_.end() == recordFound){
+            return false;
+        }
+        value = (*recordFound).second;
+    } else {
+        // const access, non-const operator[] would add null member for missing key
+        const Json::Value& records = db_[this->rootKeyName()];
+        auto keyString = toString(key);
+        if(!records.isMember(keyString)){
+            return false;
+        }
+        fromString(records[keyString].asString(), value);
+    }
+    return true;
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::findMany(const std::vector<Key>& keys, std::vector<Value>& values, std::vector<bool>& found) {
+    values.assign(keys.size(), Value());
+    found.assign(keys.size(), false);
+    for(std::size_t index = 0; index < keys.size(); ++index){
+        found[index] = this->find(keys[index], values[index]);
+    }
+}
+
+
+template<typename Key, typename Value>
+std::uint64_t SimpleDB<Key, Value>::size() {
+    if(table_){
+        return table_->size();
+    }
+    if(log_){
+        return records_.size();
+    }
+    return db_[this->rootKeyName()].size();
+}
+
+
+template<typename Key, typename Value>
+template<typename Visitor>
+void SimpleDB<Key, Value>::forEachKey(Visitor visitor) {
+    if(table_){
+        table_->forEachKey([&visitor](const ByteView& keyBytes){
+            Key key;
+            decode(keyBytes, key);
+            visitor(key);
+        });
+    } else if(log_){
+        for(const auto& record : records_){
+            visitor(record.first);
+        }
+    } else {
+        const Json::Value& records = db_[this->rootKeyName()];
+        for(const auto& keyString : records.getMemberNames()){
+            Key key;
+            fromString(keyString, key);
+            visitor(key);
+        }
+    }
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::flush() {
+    if(table_){
+        table_->flush();
+        return;
+    }
+    if(!log_){
+        if(jsonModified_){
+            this->dumpJson();
+        }
+        return;
+    }
+    log_->flush();
+    if(log_->size() >= options_.compactionMinBytes && log_->size() > options_.compactionRatio * liveLogSize_){
+        log_->compact([this](auto append){
+            for(const auto& record : records_){
+                append(Encoded<Key>{record.first}.view(), Encoded<Value>{record.second}.view());
+            }
+        });
+    }
+}
+
+
 template<typename Key, typename Value>
 void SimpleDB<Key, Value>::initDb() {
+    if(DbOptions::Format::appendLog == options_.format){
+        this->loadDbFromLog();
+        dbInited_ = true;
+        return;
+    }
+    if(DbOptions::Format::mappedHashTable == options_.format){
+        // nothing is loaded, records are read from the mapping on demand
+        table_.reset(new MappedHashFile{dbFileName_, options_});
+        dbInited_ = true;
+        return;
+    }
+
     std::fstream  dbDumpFile;
     dbDumpFile.open(dbFileName_, std::ios::out | std::ios::in);
     if (!dbDumpFile) {
@@ -130,6 +326,79 @@ void SimpleDB<Key, Value>::loadDbFromDump(std::fstream& dumpFile) {
 }
 
 
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::loadDbFromLog() {
+    log_.reset(new AppendLog{dbFileName_, options_});
+    log_->replay([this](const ByteView& keyBytes, const ByteView& valueBytes){
+        Key key;
+        Value value;
+        decode(keyBytes, key);
+        decode(valueBytes, value);
+        this->applyRecord(key, value);
+    }, [this](const ByteView& keyBytes){
+        Key key;
+        decode(keyBytes, key);
+        auto recordFound = records_.find(key);
+        if(records_.end() != recordFound){
+            liveLogSize_ -= AppendLog::recordSize(keyBytes.size, Codec<Value>::size((*recordFound).second));
+            records_.erase(recordFound);
+        }
+    });
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::dumpJson() {
+    auto dump = writer_->write(db_);
+    const std::string dumpName{dbFileName_ + ".dump"};
+    auto throwIoError = [&dumpName](const char* operation){
+        throw DbIoException(std::string{"Json db "} + operation + " failed for " + dumpName + ": " +
+                            std::strerror(errno));
+    };
+    int dumpFd = ::open(dumpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(dumpFd < 0){
+        throwIoError("open");
+    }
+    try{
+        std::size_t written{0};
+        while(written < dump.size()){
+            auto res = ::write(dumpFd, dump.data() + written, dump.size() - written);
+            if(res < 0){
+                if(EINTR == errno){
+                    continue;
+                }
+                throwIoError("write");
+            }
+            written += static_cast<std::size_t>(res);
+        }
+        if(DbOptions::FsyncPolicy::none != options_.fsyncPolicy && 0 != ::fsync(dumpFd)){
+            throwIoError("fsync");
+        }
+    } catch(...){
+        ::close(dumpFd);
+        ::unlink(dumpName.c_str());
+        throw;
+    }
+    ::close(dumpFd);
+    if(0 != std::rename(dumpName.c_str(), dbFileName_.c_str())){
+        ::unlink(dumpName.c_str());
+        throwIoError("rename");
+    }
+    jsonModified_ = false;
+}
+
+
+template<typename Key, typename Value>
+void SimpleDB<Key, Value>::applyRecord(const Key& key, const Value& value) {
+    auto insertionRes = records_.insert(std::make_pair(key, value));
+    if(!insertionRes.second){
+        liveLogSize_ -= AppendLog::recordSize(Codec<Key>::size(key), Codec<Value>::size((*insertionRes.first).second));
+        (*insertionRes.first).second = value;
+    }
+    liveLogSize_ += AppendLog::recordSize(Codec<Key>::size(key), Codec<Value>::size(value));
+}
+
+
 } // namespace
 
 #endif // SIMPLE_DB_H
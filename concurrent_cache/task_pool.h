@@ -0,0 +1,104 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "boost/noncopyable.hpp"
+
+
+namespace concurrent_cache{
+
+
+// fixed set of threads running submitted tasks in submission order. Tasks report their results themselves
+// (e.g. through promise), exception escaping a task is swallowed, so the worker survives it.
+// Destructor runs tasks submitted before it and joins the threads
+class TaskPool : boost::noncopyable  {
+    public:
+        explicit TaskPool(std::size_t threadsCount);
+        ~TaskPool();
+
+        void submit(std::function<void()> task);
+
+    private:
+        void work();
+
+        std::mutex tasksMtx_;
+        std::condition_variable tasksCv_;
+        std::deque<std::function<void()>> tasks_;
+        bool stop_;
+        std::vector<std::thread> threads_;
+};
+
+
+inline TaskPool::TaskPool(std::size_t threadsCount)
+    :stop_{false}{
+    threads_.reserve(threadsCount);
+    try{
+        for(std::size_t threadIndex = 0; threadIndex < threadsCount; ++threadIndex){
+            threads_.emplace_back(&TaskPool::work, this);
+        }
+    } catch(...){
+        {
+            std::lock_guard<std::mutex> tasksLock{tasksMtx_};
+            stop_ = true;
+        }
+        tasksCv_.notify_all();
+        for(auto& thread : threads_){
+            thread.join();
+        }
+        throw;
+    }
+}
+
+
+inline TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> tasksLock{tasksMtx_};
+        stop_ = true;
+    }
+    tasksCv_.notify_all();
+    for(auto& thread : threads_){
+        thread.join();
+    }
+}
+
+
+inline void TaskPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> tasksLock{tasksMtx_};
+        tasks_.push_back(std::move(task));
+    }
+    tasksCv_.notify_one();
+}
+
+
+inline void TaskPool::work() {
+    while(1){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> tasksLock{tasksMtx_};
+            tasksCv_.wait(tasksLock, [this](){
+                return stop_ || !tasks_.empty();
+            });
+            if(tasks_.empty()){
+                return; // stopped and drained
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        try{
+            task();
+        } catch(...){
+            // task is expected to pass its errors to the caller itself
+        }
+    }
+}
+
+
+} // namespace
+#endif // TASK_POOL_H
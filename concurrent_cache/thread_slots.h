@@ -0,0 +1,59 @@
+#ifndef THREAD_SLOTS_H
+#define THREAD_SLOTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace concurrent_cache{
+
+
+static const std::size_t cacheLineSize = 64;
+// per-thread state is spread over this many slots, threads beyond it share slots
+static const std::size_t threadSlotsCount = 32;
+
+
+// slot of calling thread, threads take slots round robin on first call, so up to threadSlotsCount threads
+// never share a slot
+inline std::size_t threadSlot(){
+    static std::atomic<std::size_t> nextSlot{0};
+    thread_local std::size_t slot{nextSlot.fetch_add(1, std::memory_order_relaxed) % threadSlotsCount};
+    return slot;
+}
+
+
+// counter incremented by many threads, each thread increments its own cache line, so increments don't
+// contend; reading sums all slots and is relatively expensive
+class StripedCounter{
+    public:
+        StripedCounter() = default;
+        StripedCounter(const StripedCounter&) = delete;
+        StripedCounter& operator=(const StripedCounter&) = delete;
+
+        void increment(){
+            slots_[threadSlot()].value.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::uint64_t load() const{
+            std::uint64_t sum{0};
+            for(const auto& slot : slots_){
+                sum += slot.value.load(std::memory_order_relaxed);
+            }
+            return sum;
+        }
+
+    private:
+        // padded rather than aligned, so owners may be allocated by plain new before C++17; counters of
+        // neighbour slots are still a cache line apart
+        struct Slot{
+                std::atomic<std::uint64_t> value{0};
+                char padding[cacheLineSize - sizeof(std::atomic<std::uint64_t>)];
+        };
+
+        Slot slots_[threadSlotsCount];
+};
+
+
+} // namespace
+#endif // THREAD_SLOTS_H
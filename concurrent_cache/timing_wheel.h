@@ -0,0 +1,138 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "boost/noncopyable.hpp"
+
+
+namespace concurrent_cache{
+
+
+// hierarchical timing wheel: 4 levels of 64 slots, level N slot spans 64^N ticks. Entry is put to the lowest
+// level whose current window contains its tick and is cascaded one level down when the wheel reaches the
+// slot, so schedule is O(1) and every entry moves at most 3 times before it fires. Ticks beyond 64^4 ticks
+// from now fire early, caller checks the real deadline and schedules the entry again
+template<typename Entry>
+class TimingWheel : boost::noncopyable  {
+    public:
+        TimingWheel();
+
+        // entry fires once wheel reaches tick, ticks not after current one fire on the next advance
+        void schedule(const Entry& entry, std::uint64_t tick);
+        // moves wheel to tick calling expire(entry) for every entry due, expire may schedule entries again
+        template<typename Expire>
+        void advance(std::uint64_t tick, Expire expire);
+        std::uint64_t currentTick() const;
+        std::size_t size() const;
+
+    private:
+        static const unsigned int slotBits = 6;
+        static const std::uint64_t slotsCount = 1 << slotBits;
+        static const unsigned int levelsCount = 4;
+
+        struct Timer{
+                std::uint64_t tick;
+                Entry entry;
+        };
+
+        // tick isn't before current one
+        void place(const Timer& timer);
+        std::vector<Timer>& slotOf(unsigned int level, std::uint64_t tick);
+
+        std::vector<std::vector<Timer>> slots_;
+        std::uint64_t currentTick_;
+        std::size_t size_;
+};
+
+
+template<typename Entry>
+TimingWheel<Entry>::TimingWheel()
+    :slots_(levelsCount * slotsCount),
+     currentTick_{0},
+     size_{0}{
+}
+
+
+template<typename Entry>
+void TimingWheel<Entry>::schedule(const Entry& entry, std::uint64_t tick) {
+    // slot of current tick has fired already
+    place(Timer{tick > currentTick_ ? tick : currentTick_ + 1, entry});
+}
+
+
+template<typename Entry>
+template<typename Expire>
+void TimingWheel<Entry>::advance(std::uint64_t tick, Expire expire) {
+    if(0 == size_){
+        currentTick_ = tick > currentTick_ ? tick : currentTick_;
+        return;
+    }
+    std::vector<Timer> due;
+    while(currentTick_ < tick){
+        ++currentTick_;
+        // reaching the start of a higher level slot window spreads its entries over lower levels, entries of
+        // the current tick among them land to the level 0 slot fired below
+        for(unsigned int level = 1; level < levelsCount; ++level){
+            if(0 != (currentTick_ & ((std::uint64_t{1} << (slotBits * level)) - 1))){
+                break;
+            }
+            due.clear();
+            due.swap(slotOf(level, currentTick_));
+            size_ -= due.size();
+            for(const auto& timer : due){
+                place(timer);
+            }
+        }
+
+        auto& slot = slotOf(0, currentTick_);
+        if(!slot.empty()){
+            due.clear();
+            due.swap(slot);
+            size_ -= due.size();
+            for(const auto& timer : due){
+                expire(timer.entry);
+            }
+        }
+    }
+}
+
+
+template<typename Entry>
+std::uint64_t TimingWheel<Entry>::currentTick() const {
+    return currentTick_;
+}
+
+
+template<typename Entry>
+std::size_t TimingWheel<Entry>::size() const {
+    return size_;
+}
+
+
+template<typename Entry>
+void TimingWheel<Entry>::place(const Timer& timer) {
+    auto tick = timer.tick;
+    if((tick >> (slotBits * levelsCount)) != (currentTick_ >> (slotBits * levelsCount))){
+        // too far, park at the end of the top level window, entry fires early there
+        tick = currentTick_ | ((std::uint64_t{1} << (slotBits * levelsCount)) - 1);
+    }
+    // the lowest level where tick and current tick differ only in this level digit
+    unsigned int level{0};
+    while(level < levelsCount - 1 && (tick >> (slotBits * (level + 1))) != (currentTick_ >> (slotBits * (level + 1)))){
+        ++level;
+    }
+    slotOf(level, tick).push_back(Timer{tick, timer.entry});
+    ++size_;
+}
+
+
+template<typename Entry>
+std::vector<typename TimingWheel<Entry>::Timer>& TimingWheel<Entry>::slotOf(unsigned int level, std::uint64_t tick) {
+    return slots_[level * slotsCount + ((tick >> (slotBits * level)) & (slotsCount - 1))];
+}
+
+
+} // namespace
+#endif // TIMING_WHEEL_H
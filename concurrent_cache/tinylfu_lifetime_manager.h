@@ -0,0 +1,204 @@
+#ifndef TINYLFU_LIFETIME_MANAGER_H
+#define TINYLFU_LIFETIME_MANAGER_H
+
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include "boost/noncopyable.hpp"
+#include "cache_exceptions.h"
+#include "frequency_sketch.h"
+#include "record_lifetime_manager.h"
+
+
+namespace concurrent_cache{
+
+
+// W-TinyLFU: new records go to small LRU window (1% of records), records pushed out of the window get into
+// probation segment of segmented LRU and are promoted to protected segment (80% of main area) on hit.
+// On eviction the newest probation record competes with the oldest one, the one requested less often
+// according to frequency sketch is evicted, so one-hit wonders don't push out popular records
+template<typename Record>
+class TinyLfuRecordLifetimeManager : boost::noncopyable  {
+    public:
+        TinyLfuRecordLifetimeManager() = default;
+        void addRecord(const Record& record);
+        void touch(const Record& record);
+        std::shared_ptr<Record> getRecordToRemove();
+        // record leaves the cache other way than eviction (e.g. expires), record must be managed
+        void removeRecord(const Record& record);
+
+    private:
+        typedef RecordTraits<Record> Traits;
+
+        static const std::size_t windowPercent = 1;
+        static const std::size_t protectedPercent = 80;
+
+        enum class Segment{
+            window,
+            probation,
+            protectedMain
+        };
+
+        struct Entry{
+                Record record;
+                Segment segment;
+                Entry(const Record& rec)
+                    :record(rec),
+                     segment{Segment::window}{}
+        };
+        typedef typename std::list<Entry>::iterator Position;
+
+        std::size_t windowTarget() const;
+        std::size_t protectedTarget() const;
+        void touchPosition(Position position);
+        void moveTo(Position position, Segment segment);
+        std::shared_ptr<Record> removeEntry(Position position);
+
+        // hits come concurrently under shard reader lock, reordering the lists needs own lock
+        std::mutex mtx_;
+        // most recently used records are at front of each segment
+        std::list<Entry> window_;
+        std::list<Entry> probation_;
+        std::list<Entry> protected_;
+        std::unordered_map<typename Traits::Id, Position> positions_;
+        FrequencySketch sketch_;
+};
+
+
+template<typename Record>
+void TinyLfuRecordLifetimeManager<Record>::addRecord(const Record& record) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    sketch_.ensureCapacity(positions_.size() + 1);
+    auto position = window_.emplace(std::begin(window_), record);
+    try{
+        auto insertionRes = positions_.emplace(Traits::id(record), position);
+        if(!insertionRes.second){
+            window_.erase(position);
+            this->touchPosition((*insertionRes.first).second);
+            return;
+        }
+    } catch(...){
+        window_.erase(position);
+        throw;
+    }
+    sketch_.increment(Traits::hash(record));
+
+    while(window_.size() > this->windowTarget()){
+        this->moveTo(std::prev(std::end(window_)), Segment::probation);
+    }
+}
+
+
+template<typename Record>
+void TinyLfuRecordLifetimeManager<Record>::touch(const Record& record) {
+    std::lock_guard<std::mutex> lock{mtx_};
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        this->touchPosition((*positionFound).second);
+    }
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> TinyLfuRecordLifetimeManager<Record>::getRecordToRemove(){
+    std::lock_guard<std::mutex> lock{mtx_};
+    if(positions_.empty()){
+        throw QueueEmpty();
+    }
+
+    // need two probation records to compare, refill probation from protected segment
+    while(probation_.size() < 2 && !protected_.empty()){
+        this->moveTo(std::prev(std::end(protected_)), Segment::probation);
+    }
+
+    Position candidate;
+    Position victim;
+    if(probation_.size() >= 2){
+        candidate = std::begin(probation_);
+        victim = std::prev(std::end(probation_));
+    } else if(!probation_.empty() && !window_.empty()){
+        candidate = std::prev(std::end(window_));
+        victim = std::begin(probation_);
+    } else if(!probation_.empty()){
+        return this->removeEntry(std::begin(probation_));
+    } else {
+        return this->removeEntry(std::prev(std::end(window_)));
+    }
+
+    // candidate is admitted only if it's requested more often than victim
+    if(sketch_.frequency(Traits::hash((*candidate).record)) > sketch_.frequency(Traits::hash((*victim).record))){
+        return this->removeEntry(victim);
+    }
+    return this->removeEntry(candidate);
+}
+
+
+template<typename Record>
+void TinyLfuRecordLifetimeManager<Record>::removeRecord(const Record& record){
+    std::lock_guard<std::mutex> lock{mtx_};
+    auto positionFound = positions_.find(Traits::id(record));
+    if(std::end(positions_) != positionFound){
+        this->removeEntry((*positionFound).second);
+    }
+}
+
+
+template<typename Record>
+std::size_t TinyLfuRecordLifetimeManager<Record>::windowTarget() const {
+    return std::max<std::size_t>(1, positions_.size() * windowPercent / 100);
+}
+
+
+template<typename Record>
+std::size_t TinyLfuRecordLifetimeManager<Record>::protectedTarget() const {
+    return (positions_.size() - std::min(positions_.size(), this->windowTarget())) * protectedPercent / 100;
+}
+
+
+template<typename Record>
+void TinyLfuRecordLifetimeManager<Record>::touchPosition(Position position) {
+    sketch_.increment(Traits::hash((*position).record));
+    switch((*position).segment){
+        case Segment::window:
+            window_.splice(std::begin(window_), window_, position);
+            break;
+        case Segment::probation:
+            this->moveTo(position, Segment::protectedMain);
+            while(protected_.size() > this->protectedTarget()){
+                this->moveTo(std::prev(std::end(protected_)), Segment::probation);
+            }
+            break;
+        case Segment::protectedMain:
+            protected_.splice(std::begin(protected_), protected_, position);
+            break;
+    }
+}
+
+
+template<typename Record>
+void TinyLfuRecordLifetimeManager<Record>::moveTo(Position position, Segment segment) {
+    auto& source = Segment::window == (*position).segment ? window_ :
+                   Segment::probation == (*position).segment ? probation_ : protected_;
+    auto& destination = Segment::window == segment ? window_ :
+                        Segment::probation == segment ? probation_ : protected_;
+    destination.splice(std::begin(destination), source, position);
+    (*position).segment = segment;
+}
+
+
+template<typename Record>
+std::shared_ptr<Record> TinyLfuRecordLifetimeManager<Record>::removeEntry(Position position){
+    std::shared_ptr<Record> recordToRemove{std::make_shared<Record>((*position).record)};
+    positions_.erase(Traits::id((*position).record));
+    auto& source = Segment::window == (*position).segment ? window_ :
+                   Segment::probation == (*position).segment ? probation_ : protected_;
+    source.erase(position);
+    return recordToRemove;
+}
+
+
+} // namespace
+#endif // TINYLFU_LIFETIME_MANAGER_H
@@ -0,0 +1,60 @@
+#ifndef WEIGHER_H
+#define WEIGHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace concurrent_cache{
+
+
+// Weigher gives weight of a record, shard evicts records until its total weight fits its share of cache
+// maxSize. Weigher is called as weigher(key, value) returning std::uint64_t on every insertion and update,
+// so it should be cheap
+
+
+// every record weighs 1, maxSize is count of records
+template<typename Key, typename Value>
+struct UnitWeigher{
+        std::uint64_t operator()(const Key&, const Value&) const{
+            return 1;
+        }
+};
+
+
+// heap bytes owned by a copy of value beyond sizeof(T), specialize for own types
+template<typename T, typename Enable = void>
+struct HeapBytes{
+        static std::size_t of(const T&){
+            return 0;
+        }
+};
+
+
+template<>
+struct HeapBytes<std::string>{
+        static std::size_t of(const std::string& value){
+            // short strings fit into the object itself, capacity of empty string is the inline capacity
+            static const std::size_t inlineCapacity{std::string().capacity()};
+            return value.size() > inlineCapacity ? value.size() + 1 : 0;
+        }
+};
+
+
+// approximate memory taken by record: key and value with their heap memory, plus fixed overhead of cache
+// structures per record
+template<typename Key, typename Value>
+struct ByteWeigher{
+        // record fields, hash table slot and control byte, lifetime manager node, malloc header of snapshot
+        static const std::uint64_t recordOverheadBytes = 96;
+
+        std::uint64_t operator()(const Key& key, const Value& value) const{
+            return sizeof(Key) + HeapBytes<Key>::of(key) + sizeof(Value) + HeapBytes<Value>::of(value) +
+                   recordOverheadBytes;
+        }
+};
+
+
+} // namespace
+#endif // WEIGHER_H
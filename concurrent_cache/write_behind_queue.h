@@ -0,0 +1,87 @@
+#ifndef WRITE_BEHIND_QUEUE_H
+#define WRITE_BEHIND_QUEUE_H
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "boost/noncopyable.hpp"
+
+
+namespace concurrent_cache{
+
+
+// lock free queue of many producers and single consumer. Producers push onto intrusive stack by CAS of its head,
+// consumer detaches the whole stack by single exchange and reverses it, so items come out in push order
+// of each producer, and neither side ever waits for the other
+template<typename Item>
+class WriteBehindQueue : boost::noncopyable  {
+    public:
+        WriteBehindQueue()
+            :head_{nullptr}{}
+        ~WriteBehindQueue();
+
+        void push(const Item& item);
+        // appends all pushed items to items in push order, single consumer only
+        void takeAll(std::vector<Item>& items);
+        bool empty() const;
+
+    private:
+        struct Node{
+                Item item;
+                Node* next;
+        };
+
+        std::atomic<Node*> head_;
+};
+
+
+template<typename Item>
+WriteBehindQueue<Item>::~WriteBehindQueue() {
+    auto node = head_.load(std::memory_order_relaxed);
+    while(nullptr != node){
+        auto next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+
+template<typename Item>
+void WriteBehindQueue<Item>::push(const Item& item) {
+    auto previous = head_.load(std::memory_order_relaxed);
+    auto node = new Node{item, previous};
+    // node may be taken by consumer as soon as it's published, so it isn't touched after successful exchange
+    while(!head_.compare_exchange_weak(previous, node, std::memory_order_release, std::memory_order_relaxed)){
+        node->next = previous;
+    }
+}
+
+
+template<typename Item>
+void WriteBehindQueue<Item>::takeAll(std::vector<Item>& items) {
+    // detached nodes are owned by consumer, no ABA, since nodes are never popped one by one
+    auto node = head_.exchange(nullptr, std::memory_order_acquire);
+    Node* reversed{nullptr};
+    while(nullptr != node){
+        auto next = node->next;
+        node->next = reversed;
+        reversed = node;
+        node = next;
+    }
+    while(nullptr != reversed){
+        auto next = reversed->next;
+        items.push_back(std::move(reversed->item));
+        delete reversed;
+        reversed = next;
+    }
+}
+
+
+template<typename Item>
+bool WriteBehindQueue<Item>::empty() const {
+    return nullptr == head_.load(std::memory_order_relaxed);
+}
+
+
+} // namespace
+#endif // WRITE_BEHIND_QUEUE_H
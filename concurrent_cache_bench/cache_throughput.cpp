@@ -0,0 +1,235 @@
+// Drives ConcurrentCache with a mix of find/update calls from several threads and prints throughput, latency
+// percentiles, hit rate and timeout rate of every configuration as json, so runs can be compared by scripts.
+// Usage: cache_throughput_bench [measurement duration per configuration, ms]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "concurrent_cache.h"
+#include "zipf_generator.h"
+
+
+struct BenchConfig{
+        unsigned int threadsCount;
+        double readRatio;
+        unsigned int keysCount;
+        bool zipfian;
+        std::uint64_t maxSize;
+};
+
+
+struct Operation{
+        int key;
+        bool write;
+};
+
+
+// log-linear histogram of nanoseconds, 8 sub-buckets per power of two, so percentile error is under 12.5%
+class LatencyHistogram{
+    public:
+        LatencyHistogram()
+            :buckets_(bucketsCount, 0),
+             count_{0}{}
+
+        void add(std::uint64_t nanoseconds){
+            ++buckets_[indexOf(nanoseconds)];
+            ++count_;
+        }
+
+        void merge(const LatencyHistogram& other){
+            for(std::size_t index = 0; index < bucketsCount; ++index){
+                buckets_[index] += other.buckets_[index];
+            }
+            count_ += other.count_;
+        }
+
+        // upper bound of bucket holding requested percentile
+        std::uint64_t percentile(double fraction) const{
+            auto rank = static_cast<std::uint64_t>(fraction * count_);
+            std::uint64_t seen{0};
+            for(std::size_t index = 0; index < bucketsCount; ++index){
+                seen += buckets_[index];
+                if(seen > rank){
+                    return upperBoundOf(index);
+                }
+            }
+            return 0;
+        }
+
+    private:
+        static const unsigned int subBucketBits = 3;
+        static const std::size_t bucketsCount = 64 << subBucketBits;
+
+        static std::size_t indexOf(std::uint64_t value){
+            if(value < (1u << subBucketBits)){
+                return static_cast<std::size_t>(value);
+            }
+            unsigned int exponent = 63 - __builtin_clzll(value);
+            auto mantissa = (value >> (exponent - subBucketBits)) & ((1u << subBucketBits) - 1);
+            return ((exponent - subBucketBits + 1) << subBucketBits) + mantissa;
+        }
+
+        static std::uint64_t upperBoundOf(std::size_t index){
+            if(index < (1u << subBucketBits)){
+                return index;
+            }
+            unsigned int exponent = static_cast<unsigned int>(index >> subBucketBits) + subBucketBits - 1;
+            std::uint64_t mantissa = index & ((1u << subBucketBits) - 1);
+            return ((((1ull << subBucketBits) | mantissa) + 1) << (exponent - subBucketBits)) - 1;
+        }
+
+        std::vector<std::uint64_t> buckets_;
+        std::uint64_t count_;
+};
+
+
+struct ThreadResult{
+        LatencyHistogram latency;
+        std::uint64_t operations{0};
+        std::uint64_t timeouts{0};
+};
+
+
+// operations are generated before run, so key generation cost isn't measured
+std::vector<Operation> makeOperations(const BenchConfig& config, unsigned int seed){
+    const std::size_t operationsCount{1 << 16};
+    std::mt19937_64 engine{seed};
+    std::uniform_int_distribution<unsigned int> uniform{0, config.keysCount - 1};
+    std::bernoulli_distribution isRead{config.readRatio};
+    std::unique_ptr<ZipfGenerator> zipf;
+    if(config.zipfian){
+        zipf.reset(new ZipfGenerator{config.keysCount, 0.99});
+    }
+    std::vector<Operation> operations;
+    operations.reserve(operationsCount);
+    for(std::size_t i = 0; i < operationsCount; ++i){
+        auto key = config.zipfian ? zipf->next(engine) : uniform(engine);
+        operations.push_back(Operation{static_cast<int>(key), !isRead(engine)});
+    }
+    return operations;
+}
+
+
+void printResult(const BenchConfig& config, double seconds, const ThreadResult& total,
+                 const concurrent_cache::CacheStats& stats, bool first){
+    auto lookups = stats.hits + stats.misses;
+    std::cout << (first ? "" : ",\n") << "    {"
+              << "\"threads\": " << config.threadsCount
+              << ", \"readRatio\": " << config.readRatio
+              << ", \"keys\": " << config.keysCount
+              << ", \"distribution\": \"" << (config.zipfian ? "zipf" : "uniform") << "\""
+              << ", \"maxSize\": " << config.maxSize
+              << ", \"opsPerSec\": " << static_cast<std::uint64_t>(total.operations / seconds)
+              << ", \"p50Ns\": " << total.latency.percentile(0.5)
+              << ", \"p99Ns\": " << total.latency.percentile(0.99)
+              << ", \"p999Ns\": " << total.latency.percentile(0.999)
+              << ", \"hitRate\": " << (lookups ? static_cast<double>(stats.hits) / lookups : 0.0)
+              << ", \"timeoutRate\": " << (total.operations ? static_cast<double>(total.timeouts) / total.operations : 0.0)
+              << "}";
+}
+
+
+void runConfig(const BenchConfig& config, std::chrono::milliseconds duration, bool first){
+    // every run starts with empty db, otherwise it grows with values synced by previous runs
+    std::remove(concurrent_cache::ConcurrentCache<int, int>::dbName());
+    concurrent_cache::CacheOptions options;
+    options.shardsCount = std::min<std::uint64_t>(16, config.maxSize);
+    concurrent_cache::ConcurrentCache<int, int> cache{config.maxSize,
+                                                      std::chrono::milliseconds{1000},
+                                                      boost::chrono::milliseconds{10},
+                                                      options};
+
+    std::atomic<bool> measuring{false};
+    std::atomic<bool> stop{false};
+    std::vector<ThreadResult> results(config.threadsCount);
+    std::vector<std::thread> threads;
+    for(unsigned int threadIndex = 0; threadIndex < config.threadsCount; ++threadIndex){
+        threads.emplace_back([&, threadIndex](){
+            auto operations = makeOperations(config, 42 + threadIndex);
+            auto& result = results[threadIndex];
+            std::size_t next{0};
+            while(!stop.load(std::memory_order_relaxed)){
+                const auto& operation = operations[next++ & (operations.size() - 1)];
+                bool timedOut{false};
+                auto startPoint = std::chrono::steady_clock::now();
+                try{
+                    if(operation.write){
+                        cache.update(operation.key, static_cast<int>(next));
+                    } else {
+                        timedOut = !cache.tryFind(operation.key);
+                    }
+                } catch (const concurrent_cache::CacheTimeoutException&){
+                    timedOut = true;
+                }
+                auto endPoint = std::chrono::steady_clock::now();
+                if(measuring.load(std::memory_order_relaxed)){
+                    result.latency.add(std::chrono::duration_cast<std::chrono::nanoseconds>(endPoint - startPoint).count());
+                    ++result.operations;
+                    result.timeouts += timedOut ? 1 : 0;
+                }
+            }
+        });
+    }
+
+    // warm up cache before measurement
+    std::this_thread::sleep_for(duration / 4);
+    auto statsBefore = cache.stats();
+    auto startPoint = std::chrono::steady_clock::now();
+    measuring.store(true);
+    std::this_thread::sleep_for(duration);
+    measuring.store(false);
+    auto endPoint = std::chrono::steady_clock::now();
+    auto statsAfter = cache.stats();
+    stop.store(true);
+    std::for_each(std::begin(threads), std::end(threads), [](std::thread& thisThread){
+        thisThread.join();
+    });
+
+    ThreadResult total;
+    for(const auto& result : results){
+        total.latency.merge(result.latency);
+        total.operations += result.operations;
+        total.timeouts += result.timeouts;
+    }
+    concurrent_cache::CacheStats stats;
+    stats.hits = statsAfter.hits - statsBefore.hits;
+    stats.misses = statsAfter.misses - statsBefore.misses;
+    printResult(config, std::chrono::duration<double>(endPoint - startPoint).count(), total, stats, first);
+}
+
+
+int main(int argc, char** argv)
+{
+    std::chrono::milliseconds duration{argc > 1 ? std::atoi(argv[1]) : 200};
+    const unsigned int threadsCounts[] = {1, 2, 4, 8};
+    const double readRatios[] = {0.5, 0.9, 0.99};
+    const unsigned int keysCounts[] = {1000, 100000};
+    const bool distributions[] = {false, true};
+    const std::uint64_t maxSizes[] = {1000, 10000};
+
+    std::cout << "{\n  \"benchmark\": \"cache_throughput\",\n  \"durationMs\": " << duration.count()
+              << ",\n  \"results\": [\n";
+    bool first{true};
+    for(auto threadsCount : threadsCounts){
+        for(auto readRatio : readRatios){
+            for(auto keysCount : keysCounts){
+                for(auto zipfian : distributions){
+                    for(auto maxSize : maxSizes){
+                        runConfig(BenchConfig{threadsCount, readRatio, keysCount, zipfian, maxSize}, duration, first);
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+    std::remove(concurrent_cache::ConcurrentCache<int, int>::dbName());
+    return 0;
+}
@@ -0,0 +1,103 @@
+// Compares std::unordered_map with FlatHashMap used by cache shards: lookup time of present and missing keys
+// in a table much larger than CPU caches, and live heap bytes per entry (counted by replaced operator new/delete)
+#include <malloc.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "flat_hash_map.h"
+
+
+static std::size_t liveBytes{0};
+
+
+// not inlined, otherwise gcc sees free of pointer returned by operator new and warns
+__attribute__((noinline)) void* operator new(std::size_t size){
+    if(void* memory = std::malloc(size)){
+        liveBytes += malloc_usable_size(memory);
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept{
+    liveBytes -= malloc_usable_size(memory);
+    std::free(memory);
+}
+
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept{
+    liveBytes -= malloc_usable_size(memory);
+    std::free(memory);
+}
+
+
+// mapped value of the size of cache record (value snapshot pointer, record lock and flags, weight, deadline, ticket)
+struct Record{
+        std::uint64_t payload[4];
+};
+
+
+template<typename Map, typename Insert>
+void report(const std::string& name, const std::vector<std::uint64_t>& keys,
+            const std::vector<std::uint64_t>& lookups, Insert insert){
+    auto bytesBefore = liveBytes;
+    Map map;
+    for(auto key : keys){
+        insert(map, key);
+    }
+    auto bytesPerEntry = static_cast<double>(liveBytes - bytesBefore) / keys.size();
+
+    std::uint64_t found{0};
+    auto startPoint = std::chrono::steady_clock::now();
+    for(auto key : lookups){
+        found += map.end() != map.find(key) ? 1 : 0;
+    }
+    auto endPoint = std::chrono::steady_clock::now();
+    auto nsPerLookup = std::chrono::duration<double, std::nano>(endPoint - startPoint).count() / lookups.size();
+
+    std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << nsPerLookup << std::setw(16) << bytesPerEntry
+              << std::setw(10) << found << std::endl;
+}
+
+
+int main()
+{
+    const std::size_t lookupsCount{1 << 23};
+    // flat table memory depends on its load: just past growth to 4M slots it's half full, before the next growth
+    // it's 7/8 full
+    for(std::size_t keysCount : {std::size_t{1} << 21, (std::size_t{1} << 22) - (std::size_t{1} << 19)}){
+        std::mt19937_64 engine{42};
+        std::vector<std::uint64_t> keys(keysCount);
+        for(auto& key : keys){
+            key = engine();
+        }
+        // half of lookups are hits of random present keys, half are misses
+        std::vector<std::uint64_t> lookups(lookupsCount);
+        std::uniform_int_distribution<std::size_t> presentKey{0, keysCount - 1};
+        for(std::size_t index = 0; index < lookupsCount; ++index){
+            lookups[index] = 0 == index % 2 ? keys[presentKey(engine)] : engine();
+        }
+
+        std::cout << keysCount << " keys, " << lookupsCount << " lookups" << std::endl;
+        std::cout << std::left << std::setw(20) << "map" << std::right << std::setw(14) << "ns/lookup"
+                  << std::setw(16) << "heap bytes/key" << std::setw(10) << "found" << std::endl;
+        report<std::unordered_map<std::uint64_t, Record>>("std::unordered_map", keys, lookups,
+            [](std::unordered_map<std::uint64_t, Record>& map, std::uint64_t key){
+                map.emplace(key, Record());
+            });
+        report<concurrent_cache::FlatHashMap<std::uint64_t, Record>>("FlatHashMap", keys, lookups,
+            [](concurrent_cache::FlatHashMap<std::uint64_t, Record>& map, std::uint64_t key){
+                map.try_emplace(key, Record());
+            });
+    }
+    return 0;
+}
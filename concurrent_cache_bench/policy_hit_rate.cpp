@@ -0,0 +1,111 @@
+// Simulates lifetime managers on synthetic traces and prints hit rate of each one,
+// no cache locking or db involved, so numbers reflect eviction policy only
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "record_lifetime_manager.h"
+#include "lru_lifetime_manager.h"
+#include "clock_lifetime_manager.h"
+#include "s3fifo_lifetime_manager.h"
+#include "tinylfu_lifetime_manager.h"
+#include "zipf_generator.h"
+
+
+typedef std::vector<unsigned int> Trace;
+
+
+Trace zipfTrace(unsigned int keysCount, double skew, std::size_t length){
+    std::mt19937_64 engine{42};
+    ZipfGenerator zipf{keysCount, skew};
+    Trace trace;
+    trace.reserve(length);
+    for(std::size_t i = 0; i < length; ++i){
+        trace.push_back(zipf.next(engine));
+    }
+    return trace;
+}
+
+
+// zipf traffic interrupted by scans of keys which are never requested again
+Trace zipfWithScansTrace(unsigned int keysCount, double skew, std::size_t length,
+                         std::size_t scanPeriod, unsigned int scanLength){
+    std::mt19937_64 engine{42};
+    ZipfGenerator zipf{keysCount, skew};
+    Trace trace;
+    trace.reserve(length);
+    unsigned int nextScanKey{keysCount};
+    while(trace.size() < length){
+        for(std::size_t i = 0; i < scanPeriod && trace.size() < length; ++i){
+            trace.push_back(zipf.next(engine));
+        }
+        for(unsigned int i = 0; i < scanLength && trace.size() < length; ++i){
+            trace.push_back(nextScanKey++);
+        }
+    }
+    return trace;
+}
+
+
+// cyclic access over working set slightly larger than cache
+Trace loopTrace(unsigned int loopLength, std::size_t length){
+    Trace trace;
+    trace.reserve(length);
+    for(std::size_t i = 0; i < length; ++i){
+        trace.push_back(static_cast<unsigned int>(i % loopLength));
+    }
+    return trace;
+}
+
+
+template<template<typename> class LifetimeManager>
+double hitRate(const Trace& trace, std::size_t capacity){
+    LifetimeManager<unsigned int> mgr;
+    std::unordered_set<unsigned int> cached;
+    std::size_t hits{0};
+    for(auto key : trace){
+        if(cached.count(key)){
+            ++hits;
+            mgr.touch(key);
+            continue;
+        }
+        if(cached.size() >= capacity){
+            cached.erase(*mgr.getRecordToRemove());
+        }
+        mgr.addRecord(key);
+        cached.insert(key);
+    }
+    return 100.0 * hits / trace.size();
+}
+
+
+void report(const std::string& name, const Trace& trace, std::size_t capacity){
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(8) << hitRate<concurrent_cache::CacheRecordLifetimeManager>(trace, capacity)
+              << std::setw(8) << hitRate<concurrent_cache::LruRecordLifetimeManager>(trace, capacity)
+              << std::setw(8) << hitRate<concurrent_cache::ClockRecordLifetimeManager>(trace, capacity)
+              << std::setw(9) << hitRate<concurrent_cache::S3FifoRecordLifetimeManager>(trace, capacity)
+              << std::setw(10) << hitRate<concurrent_cache::TinyLfuRecordLifetimeManager>(trace, capacity)
+              << std::endl;
+}
+
+
+int main()
+{
+    const std::size_t length{2000000};
+    const std::size_t capacity{1000};
+    std::cout << "hit rate, %, cache capacity " << capacity << " records, " << length << " requests" << std::endl;
+    std::cout << std::left << std::setw(36) << "trace" << std::right
+              << std::setw(8) << "FIFO" << std::setw(8) << "LRU" << std::setw(8) << "CLOCK"
+              << std::setw(9) << "S3-FIFO" << std::setw(10) << "W-TinyLFU" << std::endl;
+
+    report("zipf 0.99, 100k keys", zipfTrace(100000, 0.99, length), capacity);
+    report("zipf 0.8, 100k keys", zipfTrace(100000, 0.8, length), capacity);
+    report("zipf 0.99 + 2k-key scan every 10k", zipfWithScansTrace(100000, 0.99, length, 10000, 2000), capacity);
+    report("loop over 1200 keys", loopTrace(1200, length), capacity);
+    return 0;
+}
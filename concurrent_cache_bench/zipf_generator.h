@@ -0,0 +1,35 @@
+#ifndef ZIPF_GENERATOR_H
+#define ZIPF_GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+// key of rank r is drawn with probability proportional to 1 / (r + 1)^skew
+class ZipfGenerator{
+    public:
+        ZipfGenerator(unsigned int keysCount, double skew)
+            :cdf_(keysCount){
+            double sum{0};
+            for(unsigned int rank = 0; rank < keysCount; ++rank){
+                sum += 1.0 / std::pow(rank + 1, skew);
+                cdf_[rank] = sum;
+            }
+            for(auto& probability : cdf_){
+                probability /= sum;
+            }
+        }
+
+        unsigned int next(std::mt19937_64& engine){
+            auto point = std::uniform_real_distribution<double>(0, 1)(engine);
+            return static_cast<unsigned int>(std::lower_bound(std::begin(cdf_), std::end(cdf_), point) - std::begin(cdf_));
+        }
+
+    private:
+        std::vector<double> cdf_;
+};
+
+
+#endif // ZIPF_GENERATOR_H
@@ -0,0 +1,106 @@
+#ifndef CODEC_TEST_H
+#define CODEC_TEST_H
+
+#include <cstdio>
+#include <limits>
+#include <string>
+#include "gtest/gtest.h"
+#include "codec.h"
+#include "simple_db.h"
+
+
+template<typename T>
+T roundTrip(const T& value){
+    concurrent_cache::Encoded<T> encoded{value};
+    T decoded;
+    concurrent_cache::decode(encoded.view(), decoded);
+    return decoded;
+}
+
+
+TEST(CodecTestCase, ArithmeticRoundTrip) {
+    EXPECT_EQ(roundTrip(-123456789), -123456789);
+    EXPECT_EQ(roundTrip(std::numeric_limits<unsigned long long>::max()), std::numeric_limits<unsigned long long>::max());
+    EXPECT_EQ(roundTrip(0.1), 0.1);
+    EXPECT_EQ(roundTrip(1e-10f), 1e-10f);
+}
+
+
+TEST(CodecTestCase, ArithmeticIsLittleEndian) {
+    concurrent_cache::Encoded<std::uint32_t> encoded{0x01020304u};
+    ASSERT_EQ(encoded.view().size, 4);
+    EXPECT_EQ(encoded.view().data[0], 0x04);
+    EXPECT_EQ(encoded.view().data[3], 0x01);
+}
+
+
+TEST(CodecTestCase, StringRoundTrip) {
+    const std::string longValue(1000, 'x');
+    EXPECT_EQ(roundTrip(std::string{}).compare(""), 0);
+    EXPECT_EQ(roundTrip(std::string{"binary\0value", 12}).compare(std::string{"binary\0value", 12}), 0);
+    EXPECT_EQ(roundTrip(longValue).compare(longValue), 0);
+}
+
+
+TEST(CodecTestCase, MalformedInputThrows) {
+    concurrent_cache::Encoded<std::string> encoded{"value"};
+    std::string decoded;
+    int decodedInt;
+    ASSERT_THROW(concurrent_cache::decode(concurrent_cache::ByteView{encoded.view().data, 6}, decoded),
+                 concurrent_cache::DbParseException);
+    ASSERT_THROW(concurrent_cache::decode(encoded.view(), decodedInt), concurrent_cache::DbParseException);
+}
+
+
+struct Point{
+        int x;
+        std::string label;
+};
+
+
+namespace concurrent_cache{
+
+template<>
+struct Codec<Point>{
+        static std::size_t size(const Point& value){
+            return Codec<int>::size(value.x) + Codec<std::string>::size(value.label);
+        }
+        static void encode(const Point& value, char* out){
+            Codec<int>::encode(value.x, out);
+            Codec<std::string>::encode(value.label, out + Codec<int>::size(value.x));
+        }
+        static std::size_t decode(const char* in, std::size_t size, Point& value){
+            auto consumed = Codec<int>::decode(in, size, value.x);
+            return consumed + Codec<std::string>::decode(in + consumed, size - consumed, value.label);
+        }
+};
+
+} // namespace
+
+
+TEST(CodecTestCase, UserSpecialization) {
+    auto point = roundTrip(Point{7, "seven"});
+    EXPECT_EQ(point.x, 7);
+    EXPECT_EQ(point.label.compare("seven"), 0);
+}
+
+
+TEST(CodecTestCase, DoubleKeyKeepsPrecisionInDb) {
+    remove("test_db_codec");
+    concurrent_cache::DbOptions options;
+    options.format = concurrent_cache::DbOptions::Format::appendLog;
+    options.fsyncPolicy = concurrent_cache::DbOptions::FsyncPolicy::none;
+    {
+        concurrent_cache::SimpleDB<double, std::string> db{"test_db_codec", options};
+        // to_string would turn both keys into "0.000000"
+        db.update(1e-7, "one");
+        db.update(2e-7, "two");
+    }
+    concurrent_cache::SimpleDB<double, std::string> db{"test_db_codec", options};
+    EXPECT_EQ(db.find(1e-7).compare("one"), 0);
+    EXPECT_EQ(db.find(2e-7).compare("two"), 0);
+    remove("test_db_codec");
+}
+
+
+#endif // CODEC_TEST_H
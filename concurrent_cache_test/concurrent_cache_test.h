@@ -1,7 +1,17 @@
 #ifndef CONCURRENT_CACHE_TEST_H
 #define CONCURRENT_CACHE_TEST_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 #include "gtest/gtest.h"
 #include "concurrent_cache.h"
 
@@ -40,6 +50,219 @@ class EmptyIntCacheFixture : public ::testing::Test {
 };
 
 
+class ShardedIntCacheFixture : public ::testing::Test {
+    public:
+        ShardedIntCacheFixture()
+            :intCache{1000, std::chrono::milliseconds{1000}, boost::chrono::milliseconds{100}, shardedOptions()}{};
+
+    protected:
+        virtual void SetUp() {
+        }
+
+        virtual void TearDown() {
+
+        }
+
+        // db of its own, left by previous test is removed, so every test starts with empty db and doesn't see
+        // records written by tests of other fixtures
+        static concurrent_cache::CacheOptions shardedOptions(){
+            concurrent_cache::CacheOptions options;
+            options.shardsCount = 8;
+            options.db.path = "sharded_db.json";
+            remove(options.db.path.c_str());
+            return options;
+        }
+
+    concurrent_cache::ConcurrentCache<int, int> intCache;
+};
+
+
+// in-memory backend of int records, db of a test is shared by backend instances, since cache constructs its
+// backend itself. Lookup of the gated key blocks till the gate is opened, so test can act while the load
+// is in flight
+class GatedBackend{
+    public:
+        GatedBackend(const std::string&, const concurrent_cache::DbOptions&){}
+
+        static void reset(){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().records.clear();
+            state().listedKeys.clear();
+            state().gateClosed = false;
+            state().readerGated = false;
+        }
+
+        static void put(int key, int value){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().records[key] = value;
+        }
+
+        // key listed by forEachKey (so it's in presence filter), though lookups don't find it
+        static void list(int key){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().listedKeys.insert(key);
+        }
+
+        static int stored(int key){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            auto recordFound = state().records.find(key);
+            return state().records.end() == recordFound ? -1 : (*recordFound).second;
+        }
+
+        static void closeGate(int key){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().gatedKey = key;
+            state().gateClosed = true;
+            state().readerGated = false;
+        }
+
+        // waits till lookup of the gated key has read its value and blocked
+        static void waitForGatedReader(){
+            std::unique_lock<std::mutex> stateLock{state().mtx};
+            state().gateChanged.wait(stateLock, [](){
+                return state().readerGated;
+            });
+        }
+
+        static void openGate(){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().gateClosed = false;
+            state().gateChanged.notify_all();
+        }
+
+        void update(const int& key, const int& value){
+            put(key, value);
+        }
+
+        void updateMany(const std::vector<std::pair<int, int>>& records){
+            for(const auto& record : records){
+                put(record.first, record.second);
+            }
+        }
+
+        void remove(const int& key){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().records.erase(key);
+        }
+
+        bool find(const int& key, int& value){
+            std::unique_lock<std::mutex> stateLock{state().mtx};
+            auto recordFound = state().records.find(key);
+            bool found{state().records.end() != recordFound};
+            if(found){
+                value = (*recordFound).second;
+            }
+            if(state().gateClosed && key == state().gatedKey){
+                state().readerGated = true;
+                state().gateChanged.notify_all();
+                state().gateChanged.wait(stateLock, [](){
+                    return !state().gateClosed;
+                });
+            }
+            return found;
+        }
+
+        void findMany(const std::vector<int>& keys, std::vector<int>& values, std::vector<bool>& found){
+            values.assign(keys.size(), 0);
+            found.assign(keys.size(), false);
+            for(std::size_t index = 0; index < keys.size(); ++index){
+                found[index] = this->find(keys[index], values[index]);
+            }
+        }
+
+        std::uint64_t size(){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            return state().records.size() + state().listedKeys.size();
+        }
+
+        template<typename Visitor>
+        void forEachKey(Visitor visitor){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            for(const auto& record : state().records){
+                visitor(record.first);
+            }
+            for(auto key : state().listedKeys){
+                visitor(key);
+            }
+        }
+
+        void flush(){}
+
+    private:
+        struct State{
+                std::mutex mtx;
+                std::condition_variable gateChanged;
+                std::map<int, int> records;
+                std::set<int> listedKeys;
+                int gatedKey{0};
+                bool gateClosed{false};
+                bool readerGated{false};
+        };
+
+        static State& state(){
+            static State instance;
+            return instance;
+        }
+};
+
+
+typedef concurrent_cache::ConcurrentCache<int, int, std::hash<int>, concurrent_cache::CacheRecordLifetimeManager,
+                                          concurrent_cache::UnitWeigher<int, int>, GatedBackend> GatedIntCache;
+
+
+// unit weigher, once the gate is closed the next weighing blocks till it's opened. Cache weighs records under
+// shard write lock, so test can hold a shard locked by inserting thread
+struct GatedWeigher{
+        std::uint64_t operator()(const int& key, const int&) const{
+            std::unique_lock<std::mutex> stateLock{state().mtx};
+            if(state().gateClosed && !state().weighingGated){
+                state().weighingGated = true;
+                state().gatedKey = key;
+                state().gateChanged.notify_all();
+                state().gateChanged.wait(stateLock, [](){
+                    return !state().gateClosed;
+                });
+            }
+            return 1;
+        }
+
+        static void closeGate(){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().gateClosed = true;
+            state().weighingGated = false;
+        }
+
+        // waits till a weighing blocks, returns its key
+        static int waitForGatedWeighing(){
+            std::unique_lock<std::mutex> stateLock{state().mtx};
+            state().gateChanged.wait(stateLock, [](){
+                return state().weighingGated;
+            });
+            return state().gatedKey;
+        }
+
+        static void openGate(){
+            std::lock_guard<std::mutex> stateLock{state().mtx};
+            state().gateClosed = false;
+            state().gateChanged.notify_all();
+        }
+
+    private:
+        struct State{
+                std::mutex mtx;
+                std::condition_variable gateChanged;
+                int gatedKey{0};
+                bool gateClosed{false};
+                bool weighingGated{false};
+        };
+
+        static State& state(){
+            static State instance;
+            return instance;
+        }
+};
+
+
 void createZeroSizeCache(){
     concurrent_cache::ConcurrentCache<std::string, std::string> cache{0,
                                                                 std::chrono::milliseconds{1000},
@@ -53,6 +276,23 @@ TEST(ConcurrentCacheCommon, initZeroSizeCache) {
 }
 
 
+void createCacheWithShards(std::size_t shardsCount){
+    concurrent_cache::CacheOptions options;
+    options.shardsCount = shardsCount;
+    concurrent_cache::ConcurrentCache<std::string, std::string> cache{4,
+                                                                std::chrono::milliseconds{1000},
+                                                                boost::chrono::milliseconds{100},
+                                                                options};
+}
+
+
+TEST(ConcurrentCacheCommon, initInvalidShardsCount) {
+    ASSERT_THROW(createCacheWithShards(0), concurrent_cache::CacheInvalidArgument);
+    ASSERT_THROW(createCacheWithShards(5), concurrent_cache::CacheInvalidArgument);
+    ASSERT_NO_THROW(createCacheWithShards(4));
+}
+
+
 TEST(ConcurrentCacheCommon, maxSizeGetter) {
     EXPECT_EQ(remove("db.json"), 0);
     concurrent_cache::ConcurrentCache<std::string, std::string> cache{1,
@@ -92,6 +332,277 @@ TEST(ConcurrentCacheCommon, dumpTest) {
 }
 
 
+TEST(ConcurrentCacheCommon, dumpUpdatedAfterSync) {
+    EXPECT_EQ(remove("db.json"), 0);
+    std::unique_ptr<concurrent_cache::ConcurrentCache<int, int>> cache
+            {new concurrent_cache::ConcurrentCache<int, int>{10,
+                                                             std::chrono::milliseconds{10},
+                                                             boost::chrono::milliseconds{100}}};
+    cache->update(1, 10);
+    cache->update(2, 20);
+    // let sync thread flush both records and clear their dirty flags
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    cache->update(1, 11);
+    cache.reset(nullptr);
+
+    cache.reset(new concurrent_cache::ConcurrentCache<int, int>{10,
+                                                                std::chrono::milliseconds{10},
+                                                                boost::chrono::milliseconds{100}});
+    EXPECT_EQ(cache->find(1), 11);
+    EXPECT_EQ(cache->find(2), 20);
+}
+
+
+TEST(ConcurrentCacheCommon, chunkedSyncWithConcurrentEviction) {
+    EXPECT_EQ(remove("db.json"), 0);
+    const int keysCount{2000};
+    std::unique_ptr<concurrent_cache::ConcurrentCache<int, int>> cache
+            {new concurrent_cache::ConcurrentCache<int, int>{keysCount,
+                                                             std::chrono::milliseconds{1},
+                                                             boost::chrono::milliseconds{1000}}};
+    for(int key = 0; key < keysCount; ++key){
+        cache->update(key, key + 1);
+    }
+    // misses evict synced and unsynced records while sync walks dirty ones chunk by chunk
+    std::thread finder{[&cache, keysCount](){
+        for(int key = keysCount; key < 2 * keysCount; ++key){
+            cache->find(key);
+        }
+    }};
+    finder.join();
+    for(int key = 0; key < keysCount; ++key){
+        EXPECT_EQ(cache->find(key), key + 1);
+    }
+    cache.reset(nullptr);
+
+    cache.reset(new concurrent_cache::ConcurrentCache<int, int>{keysCount,
+                                                                std::chrono::milliseconds{1000},
+                                                                boost::chrono::milliseconds{1000}});
+    for(int key = 0; key < keysCount; ++key){
+        EXPECT_EQ(cache->find(key), key + 1);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, appendLogDump) {
+    remove("db.log");
+    concurrent_cache::CacheOptions options;
+    options.db.format = concurrent_cache::DbOptions::Format::appendLog;
+    std::unique_ptr<concurrent_cache::ConcurrentCache<int, int>> cache
+            {new concurrent_cache::ConcurrentCache<int, int>{10,
+                                                             std::chrono::milliseconds{10},
+                                                             boost::chrono::milliseconds{100},
+                                                             options}};
+    cache->update(1, 10);
+    cache.reset(nullptr);
+
+    cache.reset(new concurrent_cache::ConcurrentCache<int, int>{10,
+                                                                std::chrono::milliseconds{10},
+                                                                boost::chrono::milliseconds{100},
+                                                                options});
+    EXPECT_EQ(cache->find(1), 10);
+    cache.reset(nullptr);
+    EXPECT_EQ(remove("db.log"), 0);
+}
+
+
+concurrent_cache::CacheOptions appendLogCacheOptions(){
+    concurrent_cache::CacheOptions options;
+    options.db.format = concurrent_cache::DbOptions::Format::appendLog;
+    options.db.fsyncPolicy = concurrent_cache::DbOptions::FsyncPolicy::none;
+    return options;
+}
+
+
+// what another process opening the log would read
+int valueInLog(int key){
+    concurrent_cache::SimpleDB<int, int> db{"db.log", appendLogCacheOptions().db};
+    return db.find(key);
+}
+
+
+TEST(ConcurrentCacheCommon, flushOnDemand) {
+    remove("db.log");
+    concurrent_cache::ConcurrentCache<int, int> cache{10,
+                                                      std::chrono::milliseconds{3600 * 1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      appendLogCacheOptions()};
+    cache.update(1, 10);
+    cache.flush();
+    EXPECT_EQ(valueInLog(1), 10);
+    cache.update(1, 11);
+    cache.flush();
+    EXPECT_EQ(valueInLog(1), 11);
+}
+
+
+TEST(ConcurrentCacheCommon, flushOnDirtyThreshold) {
+    remove("db.log");
+    auto options = appendLogCacheOptions();
+    options.syncDirtyThreshold = 3;
+    concurrent_cache::ConcurrentCache<int, int> cache{10,
+                                                      std::chrono::milliseconds{3600 * 1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      options};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    EXPECT_EQ(valueInLog(1), 0);
+    cache.update(3, 30);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    while(0 == valueInLog(3) && std::chrono::steady_clock::now() < deadline){
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    EXPECT_EQ(valueInLog(1), 10);
+    EXPECT_EQ(valueInLog(3), 30);
+}
+
+
+TEST(ConcurrentCacheCommon, writeBehindWritesWithinDelay) {
+    remove("db.log");
+    auto options = appendLogCacheOptions();
+    options.writeBehindDelay = std::chrono::milliseconds{10};
+    concurrent_cache::ConcurrentCache<int, int> cache{10,
+                                                      std::chrono::milliseconds{3600 * 1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      options};
+    for(int round = 1; round <= 3; ++round){
+        // repeated updates of the key are coalesced into one write
+        cache.update(1, round * 10);
+        cache.update(1, round * 10 + 1);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+        while(round * 10 + 1 != valueInLog(1) && std::chrono::steady_clock::now() < deadline){
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        EXPECT_EQ(valueInLog(1), round * 10 + 1);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, writeThroughUpdateIsInDb) {
+    remove("db.log");
+    auto options = appendLogCacheOptions();
+    options.writePolicy = concurrent_cache::CacheOptions::WritePolicy::writeThrough;
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{3600 * 1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      options};
+    cache.update(1, 10);
+    EXPECT_EQ(valueInLog(1), 10);
+    cache.updateMany({{2, 20}, {3, 30}});
+    EXPECT_EQ(valueInLog(2), 20);
+    EXPECT_EQ(valueInLog(3), 30);
+
+    // concurrent writers share sync passes
+    const int threadsCount{8};
+    const int keysPerThread{20};
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < threadsCount; ++threadIndex){
+        threads.emplace_back([&cache, threadIndex, keysPerThread](){
+            for(int key = threadIndex * keysPerThread; key < (threadIndex + 1) * keysPerThread; ++key){
+                cache.update(key, key + 100);
+            }
+        });
+    }
+    for(auto& thisThread : threads){
+        thisThread.join();
+    }
+    concurrent_cache::SimpleDB<int, int> db{"db.log", options.db};
+    for(int key = 0; key < threadsCount * keysPerThread; ++key){
+        EXPECT_EQ(db.find(key), key + 100);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, writeThroughUpdateIsInJsonDb) {
+    concurrent_cache::CacheOptions options;
+    options.writePolicy = concurrent_cache::CacheOptions::WritePolicy::writeThrough;
+    options.db.path = "write_through_db.json";
+    remove(options.db.path.c_str());
+    {
+        concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                          std::chrono::milliseconds{3600 * 1000},
+                                                          boost::chrono::milliseconds{100},
+                                                          options};
+        cache.update(1, 10);
+        cache.updateMany({{2, 20}, {1, 11}});
+        // json is dumped by the sync pass update waited for, not on destruction only
+        concurrent_cache::SimpleDB<int, int> db{options.db.path, options.db};
+        EXPECT_EQ(db.find(1), 11);
+        EXPECT_EQ(db.find(2), 20);
+    }
+    EXPECT_EQ(remove(options.db.path.c_str()), 0);
+}
+
+
+TEST(ConcurrentCacheCommon, cachesWithOwnDbPaths) {
+    auto firstOptions = appendLogCacheOptions();
+    firstOptions.db.path = "first_db.log";
+    auto secondOptions = appendLogCacheOptions();
+    secondOptions.db.path = "second_db.log";
+    remove(firstOptions.db.path.c_str());
+    remove(secondOptions.db.path.c_str());
+    {
+        concurrent_cache::ConcurrentCache<int, int> firstCache{10,
+                                                               std::chrono::milliseconds{1000},
+                                                               boost::chrono::milliseconds{100},
+                                                               firstOptions};
+        concurrent_cache::ConcurrentCache<int, int> secondCache{10,
+                                                                std::chrono::milliseconds{1000},
+                                                                boost::chrono::milliseconds{100},
+                                                                secondOptions};
+        firstCache.update(1, 10);
+        secondCache.update(1, 20);
+    }
+    {
+        concurrent_cache::ConcurrentCache<int, int> firstCache{10,
+                                                               std::chrono::milliseconds{1000},
+                                                               boost::chrono::milliseconds{100},
+                                                               firstOptions};
+        EXPECT_EQ(firstCache.find(1), 10);
+        concurrent_cache::SimpleDB<int, int> secondDb{secondOptions.db.path, secondOptions.db};
+        EXPECT_EQ(secondDb.find(1), 20);
+    }
+    EXPECT_EQ(remove(firstOptions.db.path.c_str()), 0);
+    EXPECT_EQ(remove(secondOptions.db.path.c_str()), 0);
+}
+
+
+TEST(ConcurrentCacheCommon, nullBackendCachesOnly) {
+    concurrent_cache::ConcurrentCache<int, int, std::hash<int>, concurrent_cache::CacheRecordLifetimeManager,
+                                      concurrent_cache::UnitWeigher<int, int>,
+                                      concurrent_cache::NullBackend<int, int>> cache{2,
+                                                                                     std::chrono::milliseconds{10},
+                                                                                     boost::chrono::milliseconds{100}};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    cache.flush();
+    EXPECT_EQ(cache.find(1), 10);
+    EXPECT_EQ(cache.findMany({1, 2}), std::vector<int>({10, 20}));
+    // evicted update is gone, misses find default value
+    cache.update(3, 30);
+    EXPECT_EQ(cache.find(1), 0);
+    EXPECT_EQ(cache.findMany({4, 5}), std::vector<int>({0, 0}));
+}
+
+
+TEST(ConcurrentCacheCommon, shutdownDoesntWaitForSyncPeriod) {
+    remove("db.log");
+    auto startPoint = std::chrono::steady_clock::now();
+    {
+        concurrent_cache::ConcurrentCache<int, int> cache{10,
+                                                          std::chrono::milliseconds{3600 * 1000},
+                                                          boost::chrono::milliseconds{100},
+                                                          appendLogCacheOptions()};
+        cache.update(1, 10);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - startPoint, std::chrono::seconds{5});
+    // the last pass still writes everything
+    EXPECT_EQ(valueInLog(1), 10);
+    EXPECT_EQ(remove("db.log"), 0);
+}
+
+
 TEST(CacheTestCupport, removeDb) {
     EXPECT_EQ(remove("db.json"), 0);
 }
@@ -161,4 +672,740 @@ TEST_F(EmptyIntCacheFixture, overfillCache) {
     EXPECT_LT(intCache.maxSize(), totalValuesInserted);
 }
 
+TEST_F(EmptyIntCacheFixture, tryFind) {
+    intCache.update(6001, 7);
+    auto hit = intCache.tryFind(6001);
+    ASSERT_TRUE(static_cast<bool>(hit));
+    EXPECT_EQ(*hit, 7);
+    auto miss = intCache.tryFind(6002);
+    ASSERT_TRUE(static_cast<bool>(miss));
+    EXPECT_EQ(*miss, 0);
+    EXPECT_EQ(intCache.size(), 2);
+}
+
+TEST_F(EmptyIntCacheFixture, statsCountsHitsAndMisses) {
+    intCache.find(1);
+    intCache.find(1);
+    intCache.update(2, 20);
+    intCache.find(2);
+    auto stats = intCache.stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 1);
+}
+
+TEST_F(ShardedIntCacheFixture, shardsCountGetter) {
+    EXPECT_EQ(intCache.shardsCount(), 8);
+    EXPECT_EQ(intCache.maxSize(), 1000);
+}
+
+
+TEST_F(ShardedIntCacheFixture, overfillCache) {
+    EXPECT_EQ(intCache.size(), 0);
+    int totalValuesInserted = 0;
+    for(int nextValue = 0; nextValue < 2 * static_cast<int>(intCache.maxSize()); ++nextValue){
+        intCache.find(nextValue);
+        ++totalValuesInserted;
+    }
+    // every shard evicts on its own, so cache never exceeds total capacity
+    EXPECT_LE(intCache.size(), intCache.maxSize());
+    EXPECT_LT(intCache.maxSize(), totalValuesInserted);
+}
+
+
+TEST_F(ShardedIntCacheFixture, concurrentUpdate) {
+    const int threadsCount{8};
+    const int keysPerThread{50};
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < threadsCount; ++threadIndex){
+        threads.emplace_back([this, threadIndex, keysPerThread](){
+            for(int key = threadIndex * keysPerThread; key < (threadIndex + 1) * keysPerThread; ++key){
+                intCache.update(key, key * 2);
+            }
+        });
+    }
+    std::for_each(std::begin(threads), std::end(threads), [](std::thread& thisThread){
+        thisThread.join();
+    });
+
+    EXPECT_EQ(intCache.size(), threadsCount * keysPerThread);
+    for(int key = 0; key < threadsCount * keysPerThread; ++key){
+        EXPECT_EQ(intCache.find(key), key * 2);
+    }
+}
+
+TEST_F(ShardedIntCacheFixture, concurrentMissOnSameKey) {
+    const int threadsCount{8};
+    const int coldKey{-1};
+    std::vector<std::thread> threads;
+    std::vector<int> valuesFound(threadsCount, coldKey);
+    for(int threadIndex = 0; threadIndex < threadsCount; ++threadIndex){
+        threads.emplace_back([this, threadIndex, coldKey, &valuesFound](){
+            valuesFound[threadIndex] = intCache.find(coldKey);
+        });
+    }
+    std::for_each(std::begin(threads), std::end(threads), [](std::thread& thisThread){
+        thisThread.join();
+    });
+
+    // all misses are served by a single record
+    EXPECT_EQ(intCache.size(), 1);
+    for(auto valueFound : valuesFound){
+        EXPECT_EQ(valueFound, 0);
+    }
+}
+
+TEST_F(ShardedIntCacheFixture, concurrentMissAndUpdateOfSameKeys) {
+    const int keysCount{200};
+    std::thread updater{[this, keysCount](){
+        for(int key = 0; key < keysCount; ++key){
+            intCache.update(key, key + 1);
+        }
+    }};
+    std::thread finder{[this, keysCount](){
+        for(int key = 0; key < keysCount; ++key){
+            // either db value or the update, never anything else
+            auto valueFound = intCache.find(key);
+            EXPECT_TRUE(0 == valueFound || key + 1 == valueFound);
+        }
+    }};
+    updater.join();
+    finder.join();
+
+    // load completed after the update doesn't override it
+    for(int key = 0; key < keysCount; ++key){
+        EXPECT_EQ(intCache.find(key), key + 1);
+    }
+}
+
+TEST_F(EmptyStringCacheFixture, concurrentFindOfUpdatedKey) {
+    const std::string hotKey{"hot"};
+    stringCache.update(hotKey, std::string(100, 'a'));
+    std::atomic<bool> stop{false};
+    std::atomic<bool> torn{false};
+    std::vector<std::thread> readers;
+    for(int threadIndex = 0; threadIndex < 4; ++threadIndex){
+        readers.emplace_back([this, &hotKey, &stop, &torn](){
+            while(!stop.load()){
+                // every value written consists of one repeated letter, mix of letters means torn read
+                auto value = stringCache.find(hotKey);
+                if(value.find_first_not_of(value[0]) != std::string::npos){
+                    torn.store(true);
+                }
+            }
+        });
+    }
+    for(int i = 0; i < 10000; ++i){
+        stringCache.update(hotKey, std::string(100 + i % 50, static_cast<char>('a' + i % 26)));
+    }
+    stop.store(true);
+    std::for_each(std::begin(readers), std::end(readers), [](std::thread& thisThread){
+        thisThread.join();
+    });
+    EXPECT_FALSE(torn.load());
+    EXPECT_EQ(stringCache.size(), 1);
+}
+
+TEST_F(ShardedIntCacheFixture, updateManyThenFindMany) {
+    std::vector<std::pair<int, int>> records;
+    for(int key = 0; key < 100; ++key){
+        records.emplace_back(key, key * 3);
+    }
+    // later record of the same key wins
+    records.emplace_back(7, -7);
+    intCache.updateMany(records);
+    EXPECT_EQ(intCache.size(), 100);
+
+    std::vector<int> keys{7, 0, 99, 7, 42};
+    auto values = intCache.findMany(keys);
+    ASSERT_EQ(values.size(), keys.size());
+    EXPECT_EQ(values[0], -7);
+    EXPECT_EQ(values[1], 0);
+    EXPECT_EQ(values[2], 99 * 3);
+    EXPECT_EQ(values[3], -7);
+    EXPECT_EQ(values[4], 42 * 3);
+    EXPECT_EQ(intCache.stats().hits, keys.size());
+}
+
+TEST_F(ShardedIntCacheFixture, findManyLoadsMisses) {
+    intCache.update(1, 10);
+    // cold keys are listed twice, the second entry waits for the load made by the first one
+    std::vector<int> keys{-1, 1, -2, -1, -2};
+    auto values = intCache.findMany(keys);
+    EXPECT_EQ(values, (std::vector<int>{0, 10, 0, 0, 0}));
+    EXPECT_EQ(intCache.size(), 3);
+    EXPECT_EQ(intCache.findMany(std::vector<int>{}).size(), 0);
+}
+
+TEST_F(ShardedIntCacheFixture, concurrentFindManyOfSameKeys) {
+    const int threadsCount{8};
+    std::vector<int> keys;
+    for(int key = -1; key > -50; --key){
+        keys.push_back(key);
+    }
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < threadsCount; ++threadIndex){
+        threads.emplace_back([this, &keys](){
+            auto values = intCache.findMany(keys);
+            EXPECT_EQ(values, std::vector<int>(keys.size(), 0));
+        });
+    }
+    std::for_each(std::begin(threads), std::end(threads), [](std::thread& thisThread){
+        thisThread.join();
+    });
+    // concurrent misses of a key are served by a single record
+    EXPECT_EQ(intCache.size(), keys.size());
+}
+
+TEST_F(ShardedIntCacheFixture, findAsyncServesHitsAndMisses) {
+    intCache.update(1, 10);
+    auto hit = intCache.findAsync(1);
+    EXPECT_EQ(std::future_status::ready, hit.wait_for(std::chrono::seconds{0}));
+    EXPECT_EQ(hit.get(), 10);
+
+    // many misses are in flight at once, the same cold key is loaded once
+    std::vector<std::future<int>> misses;
+    for(int key = -1; key > -100; --key){
+        misses.push_back(intCache.findAsync(key));
+        misses.push_back(intCache.findAsync(key));
+    }
+    for(auto& miss : misses){
+        EXPECT_EQ(miss.get(), 0);
+    }
+    EXPECT_EQ(intCache.size(), 100);
+    auto stats = intCache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 1 + misses.size());
+}
+
+TEST(ConcurrentCacheCommon, initZeroLoaderThreads) {
+    concurrent_cache::CacheOptions options;
+    options.loaderThreadsCount = 0;
+    EXPECT_THROW((concurrent_cache::ConcurrentCache<int, int>{10,
+                                                              std::chrono::milliseconds{1000},
+                                                              boost::chrono::milliseconds{100},
+                                                              options}),
+                 concurrent_cache::CacheInvalidArgument);
+}
+
+concurrent_cache::CacheOptions expiryOptions(int afterWriteMs, int afterAccessMs){
+    concurrent_cache::CacheOptions options;
+    options.expireAfterWrite = std::chrono::milliseconds{afterWriteMs};
+    options.expireAfterAccess = std::chrono::milliseconds{afterAccessMs};
+    return options;
+}
+
+TEST(ConcurrentCacheCommon, expireAfterWrite) {
+    // sync thread runs often, so expired records are reclaimed soon
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{5},
+                                                      boost::chrono::milliseconds{100},
+                                                      expiryOptions(50, 0)};
+    cache.update(1, 10);
+    cache.find(-1);
+    EXPECT_EQ(cache.find(1), 10);
+    EXPECT_EQ(cache.size(), 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    EXPECT_EQ(cache.size(), 0);
+    // expired record is reloaded with the value written back to db
+    EXPECT_EQ(cache.find(1), 10);
+    EXPECT_EQ(cache.stats().misses, 2);
+}
+
+TEST(ConcurrentCacheCommon, expireAfterAccess) {
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{5},
+                                                      boost::chrono::milliseconds{100},
+                                                      expiryOptions(0, 100)};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    for(int i = 0; i < 10; ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        EXPECT_EQ(cache.find(1), 10);
+    }
+    // 2 wasn't accessed for twice its period
+    EXPECT_EQ(cache.size(), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds{300});
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(ConcurrentCacheCommon, updateWithTimeToLive) {
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{5},
+                                                      boost::chrono::milliseconds{100}};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    cache.update(2, 21, std::chrono::milliseconds{30});
+    cache.update(3, 30, std::chrono::milliseconds{30});
+    EXPECT_THROW(cache.update(4, 40, std::chrono::milliseconds{0}), concurrent_cache::CacheInvalidArgument);
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.find(2), 21);
+    EXPECT_EQ(cache.findMany(std::vector<int>{1, 3}), (std::vector<int>{10, 30}));
+}
+
+TEST(ConcurrentCacheCommon, initBothExpiryPolicies) {
+    EXPECT_THROW((concurrent_cache::ConcurrentCache<int, int>{10,
+                                                              std::chrono::milliseconds{1000},
+                                                              boost::chrono::milliseconds{100},
+                                                              expiryOptions(10, 10)}),
+                 concurrent_cache::CacheInvalidArgument);
+}
+
+TEST(ConcurrentCacheCommon, evictedUpdateIsWrittenBack) {
+    // sync never runs during the test, evicted values reach db by write back only
+    concurrent_cache::ConcurrentCache<int, int> cache{2,
+                                                      std::chrono::milliseconds{100000},
+                                                      boost::chrono::milliseconds{100}};
+    cache.update(2001, 1);
+    cache.update(2002, 2);
+    cache.update(2003, 3);
+    cache.update(2004, 4);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.findMany(std::vector<int>{2001, 2002}), (std::vector<int>{1, 2}));
+    EXPECT_EQ(cache.find(2003), 3);
+    EXPECT_EQ(cache.find(2004), 4);
+}
+
+TEST(ConcurrentCacheCommon, loadDoesntOverrideConcurrentUpdate) {
+    const int key{1};
+    for(int round = 0; round < 10; ++round){
+        GatedBackend::reset();
+        GatedBackend::put(key, 0);
+        GatedBackend::closeGate(key);
+        GatedIntCache cache{2, std::chrono::milliseconds{3600 * 1000}, boost::chrono::milliseconds{1000}};
+        int valueFound{-1};
+        std::thread finder{[&cache, &valueFound, key](){
+            valueFound = cache.find(key);
+        }};
+        // the load has read the old value, the key is updated, evicted and written back meanwhile
+        GatedBackend::waitForGatedReader();
+        cache.update(key, 1);
+        std::thread evicter{[&cache](){
+            cache.update(2, 2);
+            cache.update(3, 3);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        GatedBackend::openGate();
+        finder.join();
+        evicter.join();
+
+        EXPECT_EQ(valueFound, 1);
+        EXPECT_EQ(GatedBackend::stored(key), 1);
+        EXPECT_EQ(cache.find(key), 1);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, removeDeletesKeyFromDb) {
+    GatedBackend::reset();
+    GatedBackend::put(1, 10);
+    GatedBackend::put(2, 20);
+    std::vector<std::tuple<int, int, concurrent_cache::RemovalCause>> removed;
+    GatedIntCache cache{10, std::chrono::milliseconds{3600 * 1000}, boost::chrono::milliseconds{1000},
+                        concurrent_cache::CacheOptions(),
+                        [&removed](const int& key, const int& value, concurrent_cache::RemovalCause cause){
+                            removed.emplace_back(key, value, cause);
+                        }};
+    // cached clean record, key not cached and dirty record never synced
+    EXPECT_EQ(cache.find(1), 10);
+    cache.update(3, 30);
+    cache.remove(1);
+    cache.remove(2);
+    cache.remove(3);
+    EXPECT_EQ(cache.size(), 0);
+
+    for(int key = 1; key <= 3; ++key){
+        EXPECT_EQ(GatedBackend::stored(key), -1);
+        EXPECT_EQ(cache.find(key), 0);
+    }
+    // listener gets cached records only
+    ASSERT_EQ(removed.size(), 2);
+    EXPECT_EQ(removed[0], std::make_tuple(1, 10, concurrent_cache::RemovalCause::removed));
+    EXPECT_EQ(removed[1], std::make_tuple(3, 30, concurrent_cache::RemovalCause::removed));
+    cache.flush();
+    EXPECT_EQ(GatedBackend::stored(3), -1);
+}
+
+
+TEST(ConcurrentCacheCommon, loadDoesntCacheRemovedKey) {
+    const int key{1};
+    for(int round = 0; round < 10; ++round){
+        GatedBackend::reset();
+        GatedBackend::put(key, 5);
+        GatedBackend::closeGate(key);
+        GatedIntCache cache{2, std::chrono::milliseconds{3600 * 1000}, boost::chrono::milliseconds{1000}};
+        int valueFound{-1};
+        std::thread finder{[&cache, &valueFound, key](){
+            valueFound = cache.find(key);
+        }};
+        // the load has read the value, the key is removed meanwhile; deletion waits for the load to release db
+        GatedBackend::waitForGatedReader();
+        std::thread remover{[&cache, key](){
+            cache.remove(key);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        GatedBackend::openGate();
+        finder.join();
+        remover.join();
+
+        EXPECT_TRUE(0 == valueFound || 5 == valueFound);
+        EXPECT_EQ(GatedBackend::stored(key), -1);
+        EXPECT_EQ(cache.find(key), 0);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, batchedLoadDoesntOverrideConcurrentUpdate) {
+    typedef concurrent_cache::ConcurrentCache<int, int, std::hash<int>, concurrent_cache::CacheRecordLifetimeManager,
+                                              GatedWeigher, GatedBackend> Cache;
+    GatedBackend::reset();
+    std::vector<int> keys;
+    for(int key = 1; key <= 8; ++key){
+        GatedBackend::put(key, 0);
+        keys.push_back(key);
+    }
+    std::mutex evictedMtx;
+    std::set<int> evicted;
+    concurrent_cache::CacheOptions options;
+    options.shardsCount = 2;
+    Cache cache{4, std::chrono::milliseconds{3600 * 1000}, boost::chrono::milliseconds{20}, options,
+                [&evictedMtx, &evicted](const int& key, const int&, concurrent_cache::RemovalCause){
+                    std::lock_guard<std::mutex> evictedLock{evictedMtx};
+                    evicted.insert(key);
+                }};
+
+    // loader reads all keys, then blocks completing the first shard, while keys of the other shard wait
+    GatedWeigher::closeGate();
+    std::vector<int> valuesFound;
+    std::thread finder{[&cache, &keys, &valuesFound](){
+        valuesFound = cache.findMany(keys);
+    }};
+    GatedWeigher::waitForGatedWeighing();
+    // keys of the locked shard time out, the others are updated, evicted and written back before their load completes
+    std::set<int> updated;
+    for(auto key : keys){
+        try{
+            cache.update(key, key + 100);
+            updated.insert(key);
+        } catch(const concurrent_cache::CacheTimeoutException&){
+        }
+    }
+    ASSERT_FALSE(updated.empty());
+    for(int key = 1000; key < 2000; ++key){
+        {
+            std::lock_guard<std::mutex> evictedLock{evictedMtx};
+            if(std::includes(std::begin(evicted), std::end(evicted), std::begin(updated), std::end(updated))){
+                break;
+            }
+        }
+        try{
+            cache.update(key, key);
+        } catch(const concurrent_cache::CacheTimeoutException&){
+        }
+    }
+    GatedWeigher::openGate();
+    finder.join();
+
+    ASSERT_EQ(valuesFound.size(), keys.size());
+    for(std::size_t index = 0; index < keys.size(); ++index){
+        auto expectedValue = updated.count(keys[index]) ? keys[index] + 100 : 0;
+        EXPECT_EQ(valuesFound[index], expectedValue);
+        EXPECT_EQ(GatedBackend::stored(keys[index]), expectedValue);
+        EXPECT_EQ(cache.find(keys[index]), expectedValue);
+    }
+}
+
+
+TEST(ConcurrentCacheCommon, removalListener) {
+    std::mutex removedMtx;
+    std::vector<std::pair<int, concurrent_cache::RemovalCause>> removed;
+    concurrent_cache::ConcurrentCache<int, int> cache{2,
+                                                      std::chrono::milliseconds{5},
+                                                      boost::chrono::milliseconds{100},
+                                                      concurrent_cache::CacheOptions(),
+                                                      [&](const int& key, const int& value, concurrent_cache::RemovalCause cause){
+        EXPECT_EQ(key * 10, value);
+        std::lock_guard<std::mutex> removedLock{removedMtx};
+        removed.emplace_back(key, cause);
+    }};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    cache.update(3, 30, std::chrono::milliseconds{20});
+    {
+        std::lock_guard<std::mutex> removedLock{removedMtx};
+        ASSERT_EQ(removed.size(), 1);
+        EXPECT_EQ(removed[0].first, 1);
+        EXPECT_EQ(removed[0].second, concurrent_cache::RemovalCause::evicted);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{200});
+    std::lock_guard<std::mutex> removedLock{removedMtx};
+    ASSERT_EQ(removed.size(), 2);
+    EXPECT_EQ(removed[1].first, 3);
+    EXPECT_EQ(removed[1].second, concurrent_cache::RemovalCause::expired);
+}
+
+TEST(ConcurrentCacheCommon, removalListenerUsesCache) {
+    GatedBackend::reset();
+    concurrent_cache::CacheOptions options;
+    options.writePolicy = concurrent_cache::CacheOptions::WritePolicy::writeThrough;
+    GatedIntCache* listenedCache{nullptr};
+    std::atomic<bool> expiredHandled{false};
+    // listener updates the cache, which evicts records of the same shard and, under write through, waits for sync
+    GatedIntCache cache{2, std::chrono::milliseconds{5}, boost::chrono::milliseconds{1000}, options,
+                        [&listenedCache, &expiredHandled](const int& key, const int& value,
+                                                          concurrent_cache::RemovalCause cause){
+                            if(key < 100){
+                                listenedCache->update(key + 100, value);
+                            }
+                            if(concurrent_cache::RemovalCause::expired == cause && 4 == key){
+                                expiredHandled.store(true);
+                            }
+                        }};
+    listenedCache = &cache;
+    // evicted by caller of update
+    cache.update(1, 1);
+    cache.update(2, 2);
+    cache.update(3, 3);
+    EXPECT_EQ(GatedBackend::stored(101), 1);
+    // expired by sync thread
+    cache.update(4, 4, std::chrono::milliseconds{20});
+    for(int attempt = 0; attempt < 200 && !expiredHandled.load(); ++attempt){
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    ASSERT_TRUE(expiredHandled.load());
+    EXPECT_EQ(cache.find(104), 4);
+    cache.flush();
+    EXPECT_EQ(GatedBackend::stored(104), 4);
+}
+
+
+concurrent_cache::CacheOptions watermarkOptions(unsigned int highPercent, unsigned int lowPercent){
+    concurrent_cache::CacheOptions options;
+    options.evictionHighWatermarkPercent = highPercent;
+    options.evictionLowWatermarkPercent = lowPercent;
+    return options;
+}
+
+TEST(ConcurrentCacheCommon, overflowEvictsDownToLowWatermark) {
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      watermarkOptions(100, 50)};
+    for(int i = 0; i < 100; ++i){
+        cache.update(i, i);
+    }
+    EXPECT_EQ(cache.size(), 100);
+    cache.update(100, 100);
+    EXPECT_EQ(cache.size(), 50);
+    // the batch made room for the next misses
+    for(int i = 101; i < 150; ++i){
+        cache.find(i);
+    }
+    EXPECT_EQ(cache.size(), 99);
+    EXPECT_EQ(cache.find(100), 100);
+}
+
+TEST(ConcurrentCacheCommon, highWatermarkTrimsInBackground) {
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      watermarkOptions(90, 50)};
+    for(int i = 0; i < 91; ++i){
+        cache.update(i, i);
+    }
+    for(int attempt = 0; attempt < 100 && cache.size() > 50; ++attempt){
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    EXPECT_EQ(cache.size(), 50);
+    EXPECT_EQ(cache.find(90), 90);
+}
+
+TEST(ConcurrentCacheCommon, initInvalidWatermarks) {
+    EXPECT_THROW((concurrent_cache::ConcurrentCache<int, int>{10,
+                                                              std::chrono::milliseconds{1000},
+                                                              boost::chrono::milliseconds{100},
+                                                              watermarkOptions(50, 90)}),
+                 concurrent_cache::CacheInvalidArgument);
+    EXPECT_THROW((concurrent_cache::ConcurrentCache<int, int>{10,
+                                                              std::chrono::milliseconds{1000},
+                                                              boost::chrono::milliseconds{100},
+                                                              watermarkOptions(110, 90)}),
+                 concurrent_cache::CacheInvalidArgument);
+    EXPECT_THROW((concurrent_cache::ConcurrentCache<int, int>{10,
+                                                              std::chrono::milliseconds{1000},
+                                                              boost::chrono::milliseconds{100},
+                                                              watermarkOptions(90, 0)}),
+                 concurrent_cache::CacheInvalidArgument);
+}
+
+concurrent_cache::CacheOptions presenceFilterOptions(){
+    concurrent_cache::CacheOptions options;
+    options.presenceFilterBitsPerKey = 10;
+    return options;
+}
+
+TEST(ConcurrentCacheCommon, absentKeysArentCached) {
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      presenceFilterOptions()};
+    cache.update(4001, 1);
+    for(int key = 5000000; key < 5001000; ++key){
+        EXPECT_EQ(cache.find(key), 0);
+    }
+    EXPECT_EQ(cache.findMany(std::vector<int>{5000000, 4001, 5000001}), (std::vector<int>{0, 1, 0}));
+    EXPECT_EQ(cache.findAsync(5000002).get(), 0);
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.stats().misses, 1003);
+
+    // updated key isn't absent anymore
+    cache.update(5000000, 2);
+    EXPECT_EQ(cache.find(5000000), 2);
+    EXPECT_EQ(cache.size(), 2);
+}
+
+TEST(ConcurrentCacheCommon, presenceFilterHasDbKeys) {
+    {
+        concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                          std::chrono::milliseconds{1000},
+                                                          boost::chrono::milliseconds{100}};
+        cache.update(4002, 3);
+    }
+    concurrent_cache::ConcurrentCache<int, int> cache{100,
+                                                      std::chrono::milliseconds{1000},
+                                                      boost::chrono::milliseconds{100},
+                                                      presenceFilterOptions()};
+    EXPECT_EQ(cache.find(4002), 3);
+    EXPECT_EQ(cache.size(), 1);
+}
+
+
+TEST(ConcurrentCacheCommon, absentLoadDoesntHideConcurrentUpdate) {
+    const int key{1};
+    for(int round = 0; round < 10; ++round){
+        GatedBackend::reset();
+        // key passes presence filter, but db doesn't have it
+        GatedBackend::list(key);
+        GatedBackend::closeGate(key);
+        GatedIntCache cache{2, std::chrono::milliseconds{3600 * 1000}, boost::chrono::milliseconds{1000},
+                            presenceFilterOptions()};
+        int valueFound{-1};
+        std::thread finder{[&cache, &valueFound, key](){
+            valueFound = cache.find(key);
+        }};
+        // the load has found no value, the key is updated, evicted and written back meanwhile
+        GatedBackend::waitForGatedReader();
+        cache.update(key, 1);
+        std::thread evicter{[&cache](){
+            cache.update(2, 2);
+            cache.update(3, 3);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        GatedBackend::openGate();
+        finder.join();
+        evicter.join();
+
+        EXPECT_EQ(valueFound, 1);
+        EXPECT_EQ(GatedBackend::stored(key), 1);
+        // key isn't remembered as absent one
+        EXPECT_EQ(cache.find(key), 1);
+    }
+}
+
+typedef concurrent_cache::ConcurrentCache<std::string,
+                                         std::string,
+                                         std::hash<std::string>,
+                                         concurrent_cache::CacheRecordLifetimeManager,
+                                         concurrent_cache::ByteWeigher<std::string, std::string>> ByteWeighedCache;
+
+TEST(ConcurrentCacheCommon, byteWeigherKeepsBudget) {
+    ByteWeighedCache cache{10000, std::chrono::milliseconds{1000}, boost::chrono::milliseconds{100}};
+    for(int i = 0; i < 50; ++i){
+        cache.update("large" + std::to_string(i), std::string(1000, 'a'));
+        EXPECT_LE(cache.weight(), cache.maxSize());
+    }
+    auto largeCount = cache.size();
+    EXPECT_GT(largeCount, 0);
+    EXPECT_LT(largeCount, 10);
+
+    for(int i = 0; i < 50; ++i){
+        cache.update("small" + std::to_string(i), "a");
+        EXPECT_LE(cache.weight(), cache.maxSize());
+    }
+    // small values don't push out more than their weight
+    EXPECT_GT(cache.size(), largeCount);
+
+    // growing value evicts others to stay in budget
+    cache.update("small49", std::string(5000, 'b'));
+    EXPECT_LE(cache.weight(), cache.maxSize());
+    EXPECT_EQ(cache.find("small49").size(), 5000);
+
+    // record heavier than the whole cache is kept alone
+    cache.update("huge", std::string(20000, 'c'));
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.find("huge").size(), 20000);
+}
+
+TEST(ConcurrentCacheCommon, heapBytesOfStrings) {
+    EXPECT_EQ(concurrent_cache::HeapBytes<std::string>::of(std::string("a")), 0);
+    EXPECT_EQ(concurrent_cache::HeapBytes<std::string>::of(std::string(100, 'a')), 101);
+    EXPECT_EQ(concurrent_cache::HeapBytes<int>::of(1), 0);
+}
+
+TEST(ConcurrentCacheCommon, lruKeepsRecentlyUsed) {
+    concurrent_cache::ConcurrentCache<int, int, std::hash<int>, concurrent_cache::LruRecordLifetimeManager> cache{2,
+                                                                std::chrono::milliseconds{1000},
+                                                                boost::chrono::milliseconds{100}};
+    cache.update(1, 10);
+    cache.update(2, 20);
+    EXPECT_EQ(cache.find(1), 10);
+    // 2 is least recently used now, FIFO would evict 1 instead
+    cache.update(3, 30);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.find(1), 10);
+    EXPECT_EQ(cache.find(3), 30);
+}
+
+
+// key without std::hash, lifetime managers hash it with the cache Hasher
+struct PointKey{
+        int x;
+        int y;
+        bool operator==(const PointKey& other) const{
+            return x == other.x && y == other.y;
+        }
+};
+
+
+struct PointKeyHasher{
+        std::size_t operator()(const PointKey& key) const{
+            return std::hash<int>()(key.x) * 31 + std::hash<int>()(key.y);
+        }
+};
+
+
+template<template<typename> class LifetimeManager>
+void checkCustomHasherKeys() {
+    concurrent_cache::ConcurrentCache<PointKey, int, PointKeyHasher, LifetimeManager,
+                                      concurrent_cache::UnitWeigher<PointKey, int>,
+                                      concurrent_cache::NullBackend<PointKey, int>> cache{4,
+                                                                                          std::chrono::milliseconds{1000},
+                                                                                          boost::chrono::milliseconds{100}};
+    for(int x = 0; x < 16; ++x){
+        cache.update(PointKey{x, -x}, x);
+        EXPECT_EQ(cache.find(PointKey{x, -x}), x);
+    }
+    EXPECT_EQ(cache.size(), 4);
+    EXPECT_EQ(cache.find(PointKey{15, -15}), 15);
+}
+
+
+TEST(ConcurrentCacheCommon, s3FifoWithCustomHasherKey) {
+    checkCustomHasherKeys<concurrent_cache::S3FifoRecordLifetimeManager>();
+}
+
+
+TEST(ConcurrentCacheCommon, tinyLfuWithCustomHasherKey) {
+    checkCustomHasherKeys<concurrent_cache::TinyLfuRecordLifetimeManager>();
+}
+
 #endif // CONCURRENT_CACHE_TEST_H
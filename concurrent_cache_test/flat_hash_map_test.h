@@ -0,0 +1,87 @@
+#ifndef FLAT_HASH_MAP_TEST_H
+#define FLAT_HASH_MAP_TEST_H
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flat_hash_map.h"
+
+
+TEST(FlatHashMapTestCase, FindInEmpty) {
+    concurrent_cache::FlatHashMap<int, int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_TRUE(map.end() == map.find(1));
+    EXPECT_TRUE(map.end() == map.begin());
+    EXPECT_EQ(map.erase(1), 0);
+}
+
+
+TEST(FlatHashMapTestCase, TryEmplaceKeepsExisting) {
+    concurrent_cache::FlatHashMap<std::string, std::string> map;
+    EXPECT_TRUE(map.try_emplace("key", "first").second);
+    auto insertionRes = map.try_emplace("key", "second");
+    EXPECT_FALSE(insertionRes.second);
+    EXPECT_EQ((*insertionRes.first).second.compare("first"), 0);
+    EXPECT_EQ(map.size(), 1);
+}
+
+
+TEST(FlatHashMapTestCase, HandlesSurviveRehash) {
+    concurrent_cache::FlatHashMap<int, std::string> map;
+    auto handle = map.handle(map.try_emplace(0, "first").first);
+    for(int key = 1; key < 10000; ++key){
+        map.try_emplace(key, std::to_string(key));
+    }
+    auto found = map.findHandle(handle);
+    ASSERT_TRUE(map.end() != found);
+    EXPECT_TRUE(map.find(0) == found);
+    EXPECT_EQ((*found).second.compare("first"), 0);
+}
+
+
+TEST(FlatHashMapTestCase, ErasedHandleIsntFound) {
+    concurrent_cache::FlatHashMap<int, int> map;
+    auto first = map.handle(map.try_emplace(1, 1).first);
+    auto second = map.handle(map.try_emplace(2, 2).first);
+    map.erase(1);
+    EXPECT_TRUE(map.end() == map.findHandle(first));
+    EXPECT_EQ((*map.findHandle(second)).first, 2);
+    // handle is reused by the next entry
+    auto third = map.handle(map.try_emplace(3, 3).first);
+    EXPECT_EQ(third, first);
+    EXPECT_EQ((*map.findHandle(third)).first, 3);
+}
+
+
+TEST(FlatHashMapTestCase, MatchesUnorderedMapOnRandomOperations) {
+    concurrent_cache::FlatHashMap<int, int> map;
+    std::unordered_map<int, int> reference;
+    std::mt19937 engine{42};
+    // small key space, so erase and reinsertion hit the same groups and deleted slots are reused
+    std::uniform_int_distribution<int> keys{0, 2000};
+    for(int operation = 0; operation < 200000; ++operation){
+        auto key = keys(engine);
+        if(0 == operation % 3){
+            EXPECT_EQ(map.erase(key), reference.erase(key));
+        } else {
+            EXPECT_EQ(map.try_emplace(key, operation).second, reference.emplace(key, operation).second);
+        }
+    }
+    EXPECT_EQ(map.size(), reference.size());
+    for(const auto& record : reference){
+        auto found = map.find(record.first);
+        ASSERT_TRUE(map.end() != found);
+        EXPECT_EQ((*found).second, record.second);
+    }
+    std::size_t iterated{0};
+    for(auto& record : map){
+        EXPECT_EQ(reference.at(record.first), record.second);
+        ++iterated;
+    }
+    EXPECT_EQ(iterated, reference.size());
+}
+
+
+#endif // FLAT_HASH_MAP_TEST_H
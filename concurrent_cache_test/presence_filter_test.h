@@ -0,0 +1,34 @@
+#ifndef PRESENCE_FILTER_TEST_H
+#define PRESENCE_FILTER_TEST_H
+
+#include <cstdint>
+#include "gtest/gtest.h"
+#include "presence_filter.h"
+
+
+TEST(PresenceFilterTestCase, AddedHashesAreFound) {
+    concurrent_cache::PresenceFilter filter{1000, 10};
+    for(std::uint64_t hash = 0; hash < 1000; ++hash){
+        filter.add(hash);
+    }
+    for(std::uint64_t hash = 0; hash < 1000; ++hash){
+        EXPECT_TRUE(filter.mayContain(hash));
+    }
+}
+
+
+TEST(PresenceFilterTestCase, FalsePositivesAreRare) {
+    concurrent_cache::PresenceFilter filter{10000, 10};
+    for(std::uint64_t hash = 0; hash < 10000; ++hash){
+        filter.add(hash);
+    }
+    std::uint64_t falsePositives{0};
+    for(std::uint64_t hash = 10000; hash < 110000; ++hash){
+        falsePositives += filter.mayContain(hash) ? 1 : 0;
+    }
+    // about 1% for 10 bits per key, the filter rounds its size up, so it's even lower
+    EXPECT_LT(falsePositives, 2000);
+}
+
+
+#endif // PRESENCE_FILTER_TEST_H
@@ -0,0 +1,151 @@
+#ifndef READ_MOSTLY_MUTEX_TEST_H
+#define READ_MOSTLY_MUTEX_TEST_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "boost/thread/locks.hpp"
+#include "read_mostly_mutex.h"
+#include "thread_slots.h"
+
+
+TEST(ReadMostlySharedMutexTestCase, WriterExcludesReaders) {
+    concurrent_cache::ReadMostlySharedMutex mtx;
+    long first{0};
+    long second{0};
+    bool torn{false};
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < 8; ++threadIndex){
+        threads.emplace_back([&mtx, &first, &second, &torn, threadIndex](){
+            for(int i = 0; i < 10000; ++i){
+                if(0 == threadIndex % 4){
+                    boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx};
+                    ++first;
+                    ++second;
+                } else {
+                    boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx};
+                    if(first != second){
+                        torn = true;
+                    }
+                }
+            }
+        });
+    }
+    for(auto& thisThread : threads){
+        thisThread.join();
+    }
+    EXPECT_FALSE(torn);
+    EXPECT_EQ(first, 2 * 10000);
+}
+
+
+TEST(ReadMostlySharedMutexTestCase, TimedLocksExpire) {
+    concurrent_cache::ReadMostlySharedMutex mtx;
+    {
+        boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx};
+        std::thread writer{[&mtx](){
+            boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx, boost::chrono::milliseconds{10}};
+            EXPECT_FALSE(writeLock.owns_lock());
+        }};
+        writer.join();
+    }
+    {
+        boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx};
+        std::thread reader{[&mtx](){
+            boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx, boost::chrono::milliseconds{10}};
+            EXPECT_FALSE(readLock.owns_lock());
+        }};
+        reader.join();
+    }
+    // failed writer doesn't leave readers locked out
+    boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx, boost::chrono::milliseconds{10}};
+    EXPECT_TRUE(readLock.owns_lock());
+}
+
+
+TEST(ReadMostlySharedMutexTestCase, BackedOffWaiterTakesReleasedLock) {
+    concurrent_cache::ReadMostlySharedMutex mtx;
+    boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx};
+    std::thread reader{[&mtx](){
+        auto startPoint = std::chrono::steady_clock::now();
+        boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx, boost::chrono::seconds{10}};
+        EXPECT_TRUE(readLock.owns_lock());
+        // waiter sleeps between attempts by then, but briefly
+        EXPECT_LT(std::chrono::steady_clock::now() - startPoint, std::chrono::seconds{1});
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    writeLock.unlock();
+    reader.join();
+}
+
+
+TEST(ReadMostlySharedMutexTestCase, SoleReaderUpgrades) {
+    concurrent_cache::ReadMostlySharedMutex mtx;
+    boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx};
+    std::thread reader{[&mtx](){
+        boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> otherLock{mtx};
+        // upgrade waits for this reader to leave
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }};
+    reader.join();
+    ASSERT_TRUE(mtx.try_unlock_shared_and_lock_for(boost::chrono::seconds{1}));
+    readLock.release();
+    boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx, boost::adopt_lock};
+    std::thread blocked{[&mtx](){
+        boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> otherLock{mtx, boost::chrono::milliseconds{10}};
+        EXPECT_FALSE(otherLock.owns_lock());
+    }};
+    blocked.join();
+}
+
+
+TEST(ReadMostlySharedMutexTestCase, FailedUpgradeKeepsSharedLock) {
+    concurrent_cache::ReadMostlySharedMutex mtx;
+    boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> readLock{mtx};
+    std::atomic<bool> otherLocked{false};
+    std::atomic<bool> released{false};
+    std::thread reader{[&mtx, &otherLocked, &released](){
+        boost::shared_lock<concurrent_cache::ReadMostlySharedMutex> otherLock{mtx};
+        otherLocked = true;
+        while(!released){
+            std::this_thread::yield();
+        }
+    }};
+    while(!otherLocked){
+        std::this_thread::yield();
+    }
+    EXPECT_FALSE(mtx.try_unlock_shared_and_lock_for(boost::chrono::milliseconds{10}));
+    // both readers still hold the lock, writer can't come in
+    std::thread writer{[&mtx](){
+        boost::unique_lock<concurrent_cache::ReadMostlySharedMutex> writeLock{mtx, boost::chrono::milliseconds{10}};
+        EXPECT_FALSE(writeLock.owns_lock());
+    }};
+    writer.join();
+    released = true;
+    reader.join();
+    EXPECT_TRUE(mtx.try_unlock_shared_and_lock_for(boost::chrono::milliseconds{10}));
+    readLock.release();
+    mtx.unlock();
+}
+
+
+TEST(StripedCounterTestCase, SumsAllThreads) {
+    concurrent_cache::StripedCounter counter;
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < 8; ++threadIndex){
+        threads.emplace_back([&counter](){
+            for(int i = 0; i < 1000; ++i){
+                counter.increment();
+            }
+        });
+    }
+    for(auto& thisThread : threads){
+        thisThread.join();
+    }
+    EXPECT_EQ(counter.load(), 8000);
+}
+
+
+#endif // READ_MOSTLY_MUTEX_TEST_H
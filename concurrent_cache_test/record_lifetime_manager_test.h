@@ -2,8 +2,13 @@
 #define RECORD_LIFETIME_MANAGER_TEST_H
 
 #include <limits>
+#include <set>
 #include "gtest/gtest.h"
 #include "record_lifetime_manager.h"
+#include "lru_lifetime_manager.h"
+#include "clock_lifetime_manager.h"
+#include "s3fifo_lifetime_manager.h"
+#include "tinylfu_lifetime_manager.h"
 #include "cache_exceptions.h"
 
 
@@ -34,4 +39,146 @@ TEST(CacheRecordLifetimeManagerTestCase, SingleInsertion) {
 }
 
 
+template<typename Manager>
+class LifetimeManagerPolicyTestCase : public ::testing::Test {
+    protected:
+        Manager mgr;
+};
+
+typedef ::testing::Types<concurrent_cache::CacheRecordLifetimeManager<unsigned int>,
+                         concurrent_cache::LruRecordLifetimeManager<unsigned int>,
+                         concurrent_cache::ClockRecordLifetimeManager<unsigned int>,
+                         concurrent_cache::S3FifoRecordLifetimeManager<unsigned int>,
+                         concurrent_cache::TinyLfuRecordLifetimeManager<unsigned int>> LifetimeManagerPolicies;
+TYPED_TEST_CASE(LifetimeManagerPolicyTestCase, LifetimeManagerPolicies);
+
+
+TYPED_TEST(LifetimeManagerPolicyTestCase, RemoveFromEmpty) {
+    ASSERT_THROW(this->mgr.getRecordToRemove(), concurrent_cache::QueueEmpty);
+}
+
+
+TYPED_TEST(LifetimeManagerPolicyTestCase, EveryRecordRemovedOnce) {
+    unsigned int limit{1000};
+    for(unsigned int i = 0; i < limit; ++i) {
+        this->mgr.addRecord(i);
+        if(0 == i % 3){
+            this->mgr.touch(i / 2);
+        }
+    }
+
+    std::set<unsigned int> removed;
+    for(unsigned int i = 0; i < limit; ++i) {
+        EXPECT_TRUE(removed.insert(*this->mgr.getRecordToRemove()).second);
+    }
+    EXPECT_EQ(removed.size(), limit);
+    ASSERT_THROW(this->mgr.getRecordToRemove(), concurrent_cache::QueueEmpty);
+}
+
+
+TYPED_TEST(LifetimeManagerPolicyTestCase, RemovedRecordIsntEvicted) {
+    unsigned int limit{100};
+    for(unsigned int i = 0; i < limit; ++i) {
+        this->mgr.addRecord(i);
+    }
+    for(unsigned int i = 0; i < limit; i += 2) {
+        this->mgr.removeRecord(i);
+    }
+    // removed record may come back later
+    this->mgr.addRecord(0);
+
+    std::set<unsigned int> removed;
+    for(unsigned int i = 0; i < limit / 2 + 1; ++i) {
+        auto record = *this->mgr.getRecordToRemove();
+        EXPECT_TRUE(0 == record || 1 == record % 2);
+        EXPECT_TRUE(removed.insert(record).second);
+    }
+    ASSERT_THROW(this->mgr.getRecordToRemove(), concurrent_cache::QueueEmpty);
+}
+
+
+TEST(LruRecordLifetimeManagerTestCase, TouchedRemovedLast) {
+    concurrent_cache::LruRecordLifetimeManager<unsigned int> mgr;
+    mgr.addRecord(1);
+    mgr.addRecord(2);
+    mgr.addRecord(3);
+    mgr.touch(1);
+    EXPECT_EQ(2, *mgr.getRecordToRemove());
+    EXPECT_EQ(3, *mgr.getRecordToRemove());
+    EXPECT_EQ(1, *mgr.getRecordToRemove());
+}
+
+
+TEST(ClockRecordLifetimeManagerTestCase, TouchedGetsSecondChance) {
+    concurrent_cache::ClockRecordLifetimeManager<unsigned int> mgr;
+    mgr.addRecord(1);
+    mgr.addRecord(2);
+    mgr.addRecord(3);
+    mgr.touch(1);
+    EXPECT_EQ(2, *mgr.getRecordToRemove());
+    EXPECT_EQ(3, *mgr.getRecordToRemove());
+    EXPECT_EQ(1, *mgr.getRecordToRemove());
+}
+
+
+TEST(S3FifoRecordLifetimeManagerTestCase, TouchedSurvivesOneHitWonders) {
+    concurrent_cache::S3FifoRecordLifetimeManager<unsigned int> mgr;
+    unsigned int limit{100};
+    for(unsigned int i = 0; i < limit; ++i) {
+        mgr.addRecord(i);
+    }
+    mgr.touch(0);
+    // every insertion of a new record evicts one, hot record stays
+    for(unsigned int i = limit; i < 3 * limit; ++i) {
+        EXPECT_NE(0, *mgr.getRecordToRemove());
+        mgr.addRecord(i);
+        mgr.touch(0);
+    }
+}
+
+
+TEST(TinyLfuRecordLifetimeManagerTestCase, FrequentSurvivesOneHitWonders) {
+    concurrent_cache::TinyLfuRecordLifetimeManager<unsigned int> mgr;
+    unsigned int limit{100};
+    for(unsigned int i = 0; i < limit; ++i) {
+        mgr.addRecord(i);
+    }
+    for(unsigned int hit = 0; hit < 5; ++hit) {
+        mgr.touch(0);
+    }
+    for(unsigned int i = limit; i < 3 * limit; ++i) {
+        EXPECT_NE(0, *mgr.getRecordToRemove());
+        mgr.addRecord(i);
+    }
+}
+
+
+// cache records reach managers as handles with the key hash made by cache Hasher, records are told apart by
+// handle id even if their key hashes collide
+template<template<typename> class LifetimeManager>
+void checkRecordHandles() {
+    LifetimeManager<concurrent_cache::RecordHandle> mgr;
+    for(std::uint32_t id = 0; id < 8; ++id){
+        mgr.addRecord(concurrent_cache::RecordHandle{id, 42});
+    }
+    mgr.touch(concurrent_cache::RecordHandle{0, 42});
+    std::set<std::uint32_t> evicted;
+    for(int record = 0; record < 8; ++record){
+        evicted.insert((*mgr.getRecordToRemove()).id);
+    }
+    EXPECT_EQ(evicted.size(), 8);
+    ASSERT_THROW(mgr.getRecordToRemove(), concurrent_cache::QueueEmpty);
+}
+
+
+TEST(S3FifoRecordLifetimeManagerTestCase, RecordHandlesWithCollidingHashes) {
+    checkRecordHandles<concurrent_cache::S3FifoRecordLifetimeManager>();
+}
+
+
+TEST(TinyLfuRecordLifetimeManagerTestCase, RecordHandlesWithCollidingHashes) {
+    checkRecordHandles<concurrent_cache::TinyLfuRecordLifetimeManager>();
+}
+
+
 #endif // RECORD_LIFETIME_MANAGER_TEST_H
@@ -0,0 +1,46 @@
+#ifndef RECORD_LOCK_TEST_H
+#define RECORD_LOCK_TEST_H
+
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "boost/thread/locks.hpp"
+#include "record_lock.h"
+
+
+TEST(RecordLockTestCase, ExcludesOtherOwners) {
+    concurrent_cache::RecordLock mtx;
+    long counter{0};
+    std::vector<std::thread> threads;
+    for(int threadIndex = 0; threadIndex < 8; ++threadIndex){
+        threads.emplace_back([&mtx, &counter](){
+            for(int i = 0; i < 10000; ++i){
+                boost::unique_lock<concurrent_cache::RecordLock> recordLock{mtx};
+                ++counter;
+            }
+        });
+    }
+    for(auto& thisThread : threads){
+        thisThread.join();
+    }
+    EXPECT_EQ(counter, 8 * 10000);
+    EXPECT_EQ(sizeof(concurrent_cache::RecordLock), 1u);
+}
+
+
+TEST(RecordLockTestCase, TimedLockExpires) {
+    concurrent_cache::RecordLock mtx;
+    {
+        boost::unique_lock<concurrent_cache::RecordLock> recordLock{mtx};
+        std::thread waiter{[&mtx](){
+            boost::unique_lock<concurrent_cache::RecordLock> timedLock{mtx, boost::chrono::milliseconds{10}};
+            EXPECT_FALSE(timedLock.owns_lock());
+        }};
+        waiter.join();
+    }
+    boost::unique_lock<concurrent_cache::RecordLock> timedLock{mtx, boost::chrono::milliseconds{10}};
+    EXPECT_TRUE(timedLock.owns_lock());
+}
+
+
+#endif // RECORD_LOCK_TEST_H
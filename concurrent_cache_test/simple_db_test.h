@@ -1,7 +1,14 @@
 #ifndef SIMPLE_DB_TEST_H
 #define SIMPLE_DB_TEST_H
+#include <csignal>
 #include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
 #include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 #include "simple_db.h"
 
@@ -37,9 +44,354 @@ TEST_F(SimpleDbFixture, Insertion) {
 }
 
 
+TEST_F(SimpleDbFixture, FindReportsAbsentKey) {
+    simpleDb.update("present", "value");
+    std::string value{"untouched"};
+    EXPECT_FALSE(simpleDb.find("absent", value));
+    EXPECT_EQ(value.compare("untouched"), 0);
+    EXPECT_TRUE(simpleDb.find("present", value));
+    EXPECT_EQ(value.compare("value"), 0);
+
+    // lookups of absent keys don't add them
+    std::set<std::string> keys;
+    simpleDb.forEachKey([&keys](const std::string& key){
+        keys.insert(key);
+    });
+    EXPECT_EQ(keys.count("absent"), 0);
+    EXPECT_EQ(keys.count("present"), 1);
+    EXPECT_EQ(keys.size(), simpleDb.size());
+}
+
+
+TEST_F(SimpleDbFixture, RemovedKeyIsAbsent) {
+    simpleDb.update("kept", "value");
+    simpleDb.update("removed", "value");
+    simpleDb.remove("removed");
+    simpleDb.remove("never_stored");
+    std::string value{"untouched"};
+    EXPECT_FALSE(simpleDb.find("removed", value));
+    EXPECT_EQ(value.compare("untouched"), 0);
+    EXPECT_EQ(simpleDb.find("kept").compare("value"), 0);
+}
+
+
 TEST(TestSupport, removeDbIfExistsAfter) {
     remove("test_db_str");
 }
 
 
+concurrent_cache::DbOptions appendLogOptions(){
+    concurrent_cache::DbOptions options;
+    options.format = concurrent_cache::DbOptions::Format::appendLog;
+    options.fsyncPolicy = concurrent_cache::DbOptions::FsyncPolicy::none;
+    return options;
+}
+
+
+TEST(AppendLogDbTestCase, ReplayAfterReopen) {
+    remove("test_db_log");
+    {
+        concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+        db.update(1, "one");
+        db.update(2, "two");
+        db.update(1, "uno");
+    }
+    concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+    EXPECT_EQ(db.find(1).compare("uno"), 0);
+    EXPECT_EQ(db.find(2).compare("two"), 0);
+    EXPECT_EQ(db.find(3).compare(""), 0);
+    remove("test_db_log");
+}
+
+
+TEST(AppendLogDbTestCase, HeaderIsLittleEndian) {
+    remove("test_db_log");
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_log", appendLogOptions()};
+        db.update(1, 2);
+    }
+    std::ifstream logFile{"test_db_log", std::ios::in | std::ios::binary};
+    std::string bytes{std::istreambuf_iterator<char>(logFile), std::istreambuf_iterator<char>()};
+    // key length 4, value length 4, then checksum, key and value
+    ASSERT_EQ(bytes.size(), 20);
+    EXPECT_EQ(bytes.substr(0, 8), std::string("\x04\0\0\0\x04\0\0\0", 8));
+    EXPECT_EQ(bytes.substr(12), std::string("\x01\0\0\0\x02\0\0\0", 8));
+    remove("test_db_log");
+}
+
+
+TEST(AppendLogDbTestCase, TornTailIsDropped) {
+    remove("test_db_log");
+    {
+        concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+        db.update(1, "one");
+    }
+    {
+        // half written record
+        std::ofstream logFile{"test_db_log", std::ios::out | std::ios::binary | std::ios::app};
+        logFile << "garbage";
+    }
+    {
+        concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+        EXPECT_EQ(db.find(1).compare("one"), 0);
+        db.update(2, "two");
+    }
+    concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+    EXPECT_EQ(db.find(1).compare("one"), 0);
+    EXPECT_EQ(db.find(2).compare("two"), 0);
+    remove("test_db_log");
+}
+
+
+TEST(AppendLogDbTestCase, RemovalSurvivesReopenAndCompaction) {
+    remove("test_db_log");
+    auto options = appendLogOptions();
+    options.compactionMinBytes = 1024;
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_log", options};
+        for(int key = 0; key < 10; ++key){
+            db.update(key, key);
+        }
+        db.remove(3);
+        db.remove(42);
+        EXPECT_EQ(db.size(), 9);
+    }
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_log", options};
+        int value{-1};
+        EXPECT_FALSE(db.find(3, value));
+        EXPECT_EQ(db.size(), 9);
+        // removed key can be stored again
+        db.update(3, 30);
+        db.remove(4);
+        for(int i = 0; i < 1000; ++i){
+            db.update(5, i);
+        }
+        db.flush();
+    }
+    concurrent_cache::SimpleDB<int, int> db{"test_db_log", options};
+    EXPECT_EQ(db.find(3), 30);
+    int value{-1};
+    EXPECT_FALSE(db.find(4, value));
+    EXPECT_EQ(db.find(5), 999);
+    EXPECT_EQ(db.size(), 9);
+    remove("test_db_log");
+}
+
+
+TEST(AppendLogDbTestCase, CompactionKeepsLatestValues) {
+    remove("test_db_log");
+    auto options = appendLogOptions();
+    options.compactionMinBytes = 1024;
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_log", options};
+        for(int i = 0; i < 1000; ++i){
+            db.update(i % 10, i);
+        }
+        db.flush();
+    }
+    std::ifstream logFile{"test_db_log", std::ios::in | std::ios::binary | std::ios::ate};
+    EXPECT_LT(logFile.tellg(), 1024);
+
+    concurrent_cache::SimpleDB<int, int> db{"test_db_log", options};
+    for(int key = 0; key < 10; ++key){
+        EXPECT_EQ(db.find(key), 990 + key);
+    }
+    remove("test_db_log");
+}
+
+
+concurrent_cache::DbOptions mappedTableOptions(){
+    concurrent_cache::DbOptions options;
+    options.format = concurrent_cache::DbOptions::Format::mappedHashTable;
+    options.fsyncPolicy = concurrent_cache::DbOptions::FsyncPolicy::none;
+    return options;
+}
+
+
+void removeMappedTable(){
+    remove("test_db_bin");
+    remove("test_db_bin.index");
+}
+
+
+TEST(MappedTableDbTestCase, FindAfterReopen) {
+    removeMappedTable();
+    {
+        concurrent_cache::SimpleDB<int, std::string> db{"test_db_bin", mappedTableOptions()};
+        db.update(1, "one");
+        db.update(2, "two");
+        // shorter value is written in place, longer one is appended
+        db.update(1, "1");
+        db.update(2, "two hundred and twenty two");
+    }
+    concurrent_cache::SimpleDB<int, std::string> db{"test_db_bin", mappedTableOptions()};
+    EXPECT_EQ(db.find(1).compare("1"), 0);
+    EXPECT_EQ(db.find(2).compare("two hundred and twenty two"), 0);
+    EXPECT_EQ(db.find(3).compare(""), 0);
+    removeMappedTable();
+}
+
+
+TEST(MappedTableDbTestCase, KeysAreListed) {
+    removeMappedTable();
+    concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+    for(int key = 0; key < 100; ++key){
+        db.update(key, key);
+    }
+    db.update(7, 70);
+    int value{-1};
+    EXPECT_FALSE(db.find(100, value));
+    EXPECT_EQ(value, -1);
+    std::set<int> keys;
+    db.forEachKey([&keys](const int& key){
+        keys.insert(key);
+    });
+    EXPECT_EQ(keys.size(), 100);
+    EXPECT_EQ(db.size(), 100);
+    EXPECT_EQ(*keys.rbegin(), 99);
+    removeMappedTable();
+}
+
+
+TEST(MappedTableDbTestCase, RemovalKeepsProbeRunsReachable) {
+    removeMappedTable();
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+        // enough keys for buckets to collide, every third one is removed
+        for(int key = 0; key < 600; ++key){
+            db.update(key, key);
+        }
+        for(int key = 0; key < 600; key += 3){
+            db.remove(key);
+        }
+        db.remove(1000);
+        EXPECT_EQ(db.size(), 400);
+        for(int key = 0; key < 600; ++key){
+            int value{-1};
+            EXPECT_EQ(db.find(key, value), 0 != key % 3);
+        }
+        db.update(3, 33);
+    }
+    // index rebuilt from data drops removed keys as well
+    remove("test_db_bin.index");
+    concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+    EXPECT_EQ(db.size(), 401);
+    EXPECT_EQ(db.find(3), 33);
+    for(int key = 4; key < 600; ++key){
+        int value{-1};
+        EXPECT_EQ(db.find(key, value), 0 != key % 3);
+    }
+    removeMappedTable();
+}
+
+
+TEST(MappedTableDbTestCase, IndexIsRebuiltIfItDoesntMatchData) {
+    removeMappedTable();
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+        for(int key = 0; key < 2000; ++key){
+            db.update(key, key);
+        }
+    }
+    // index of removed data file isn't trusted
+    remove("test_db_bin");
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+        EXPECT_EQ(db.size(), 0);
+        int value{-1};
+        EXPECT_FALSE(db.find(1, value));
+        std::size_t keysCount{0};
+        db.forEachKey([&keysCount](const int&){
+            ++keysCount;
+        });
+        EXPECT_EQ(keysCount, 0);
+        db.update(1, 10);
+    }
+    // truncated index doesn't match its header
+    {
+        std::ifstream indexFile{"test_db_bin.index", std::ios::in | std::ios::binary | std::ios::ate};
+        ASSERT_EQ(::truncate("test_db_bin.index", indexFile.tellg() / 2), 0);
+    }
+    concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+    EXPECT_EQ(db.size(), 1);
+    EXPECT_EQ(db.find(1), 10);
+    removeMappedTable();
+}
+
+
+TEST(MappedTableDbTestCase, FailedGrowthKeepsRecords) {
+    removeMappedTable();
+    concurrent_cache::SimpleDB<int, std::string> db{"test_db_bin", mappedTableOptions()};
+    const std::string value(1000, 'v');
+    db.update(0, value);
+    // file size limit makes growth of the data file fail, signal is ignored so ftruncate just reports EFBIG
+    auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    rlimit previousLimit;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &previousLimit), 0);
+    rlimit limit = previousLimit;
+    limit.rlim_cur = 64 * 1024;
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limit), 0);
+    int key{1};
+    try{
+        for(; key < 1000; ++key){
+            db.update(key, value);
+        }
+    } catch(const concurrent_cache::DbIoException&){
+    }
+    ::setrlimit(RLIMIT_FSIZE, &previousLimit);
+    std::signal(SIGXFSZ, previousHandler);
+    ASSERT_LT(key, 1000);
+
+    // records written before the failure are still mapped, and db grows once the limit is gone
+    for(int writtenKey = 0; writtenKey < key; ++writtenKey){
+        EXPECT_EQ(db.find(writtenKey).compare(value), 0);
+    }
+    db.update(key, value);
+    EXPECT_EQ(db.find(key).compare(value), 0);
+    removeMappedTable();
+}
+
+
+TEST(AppendLogDbTestCase, BatchesMatchSingleRecordCalls) {
+    remove("test_db_log");
+    concurrent_cache::SimpleDB<int, std::string> db{"test_db_log", appendLogOptions()};
+    db.updateMany({{1, "one"}, {2, "two"}, {1, "uno"}});
+    std::vector<std::string> values;
+    std::vector<bool> found;
+    db.findMany({1, 3, 2}, values, found);
+    ASSERT_EQ(values.size(), 3);
+    ASSERT_EQ(found.size(), 3);
+    EXPECT_TRUE(found[0]);
+    EXPECT_EQ(values[0].compare("uno"), 0);
+    EXPECT_FALSE(found[1]);
+    EXPECT_EQ(values[1].compare(""), 0);
+    EXPECT_TRUE(found[2]);
+    EXPECT_EQ(values[2].compare("two"), 0);
+    remove("test_db_log");
+}
+
+
+TEST(MappedTableDbTestCase, GrowsBeyondInitialSize) {
+    removeMappedTable();
+    const int recordsCount{20000};
+    {
+        concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+        for(int key = 0; key < recordsCount; ++key){
+            db.update(key, key * 3);
+        }
+        for(int key = 0; key < recordsCount; ++key){
+            EXPECT_EQ(db.find(key), key * 3);
+        }
+    }
+    // lost index is rebuilt from data file
+    remove("test_db_bin.index");
+    concurrent_cache::SimpleDB<int, int> db{"test_db_bin", mappedTableOptions()};
+    for(int key = 0; key < recordsCount; ++key){
+        EXPECT_EQ(db.find(key), key * 3);
+    }
+    removeMappedTable();
+}
+
+
 #endif // SIMPLE_DB_TEST_H
@@ -1,6 +1,13 @@
 #include "gtest/gtest.h"
 #include "record_lifetime_manager_test.h"
+#include "read_mostly_mutex_test.h"
+#include "record_lock_test.h"
+#include "flat_hash_map_test.h"
+#include "timing_wheel_test.h"
+#include "presence_filter_test.h"
+#include "write_behind_queue_test.h"
 #include "simple_db_test.h"
+#include "codec_test.h"
 #include "concurrent_cache_test.h"
 
 int main(int argc, char **argv) {
@@ -0,0 +1,60 @@
+#ifndef TIMING_WHEEL_TEST_H
+#define TIMING_WHEEL_TEST_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "gtest/gtest.h"
+#include "timing_wheel.h"
+
+
+TEST(TimingWheelTestCase, EntriesFireAtTheirTicks) {
+    concurrent_cache::TimingWheel<std::uint64_t> wheel;
+    // entries are their own ticks, spread over all levels
+    std::vector<std::uint64_t> ticks{1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 70000, 262143, 262144, 1000000};
+    for(auto tick : ticks){
+        wheel.schedule(tick, tick);
+    }
+    EXPECT_EQ(wheel.size(), ticks.size());
+
+    std::map<std::uint64_t, std::uint64_t> firedAt;
+    // uneven steps, as sync passes are
+    for(std::uint64_t now = 0; now <= 1000000; now += 37){
+        wheel.advance(now, [&firedAt, &wheel](std::uint64_t entry){
+            firedAt[entry] = wheel.currentTick();
+        });
+    }
+    wheel.advance(1000000, [&firedAt, &wheel](std::uint64_t entry){
+        firedAt[entry] = wheel.currentTick();
+    });
+    EXPECT_EQ(wheel.size(), 0);
+    ASSERT_EQ(firedAt.size(), ticks.size());
+    for(const auto& fired : firedAt){
+        EXPECT_EQ(fired.first, fired.second);
+    }
+}
+
+
+TEST(TimingWheelTestCase, PastAndFarTicks) {
+    concurrent_cache::TimingWheel<int> wheel;
+    wheel.advance(100, [](int){});
+    EXPECT_EQ(wheel.currentTick(), 100);
+
+    std::vector<int> fired;
+    // past tick fires on the next advance
+    wheel.schedule(1, 50);
+    // ticks beyond the wheel span fire early, caller schedules them again
+    wheel.schedule(2, std::uint64_t{1} << 40);
+    wheel.advance(101, [&fired](int entry){
+        fired.push_back(entry);
+    });
+    EXPECT_EQ(fired, std::vector<int>{1});
+    wheel.advance(std::uint64_t{1} << 24, [&fired](int entry){
+        fired.push_back(entry);
+    });
+    EXPECT_EQ(fired, (std::vector<int>{1, 2}));
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+
+#endif // TIMING_WHEEL_TEST_H
@@ -0,0 +1,63 @@
+#ifndef WRITE_BEHIND_QUEUE_TEST_H
+#define WRITE_BEHIND_QUEUE_TEST_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "write_behind_queue.h"
+
+
+TEST(WriteBehindQueueTestCase, TakesItemsInPushOrder) {
+    concurrent_cache::WriteBehindQueue<int> queue;
+    EXPECT_TRUE(queue.empty());
+    for(int item = 0; item < 10; ++item){
+        queue.push(item);
+    }
+    EXPECT_FALSE(queue.empty());
+    std::vector<int> items{-1};
+    queue.takeAll(items);
+    EXPECT_TRUE(queue.empty());
+    ASSERT_EQ(items.size(), 11);
+    for(int item = 0; item < 10; ++item){
+        EXPECT_EQ(items[item + 1], item);
+    }
+}
+
+
+TEST(WriteBehindQueueTestCase, ConcurrentProducersLoseNothing) {
+    const int producersCount{4};
+    const int itemsPerProducer{10000};
+    concurrent_cache::WriteBehindQueue<int> queue;
+    std::atomic<int> producersDone{0};
+    std::vector<std::thread> producers;
+    for(int producerIndex = 0; producerIndex < producersCount; ++producerIndex){
+        producers.emplace_back([&queue, &producersDone, producerIndex, itemsPerProducer](){
+            for(int item = 0; item < itemsPerProducer; ++item){
+                queue.push(producerIndex * itemsPerProducer + item);
+            }
+            ++producersDone;
+        });
+    }
+    // consumer drains while producers push
+    std::vector<int> items;
+    while(producersDone < producersCount){
+        queue.takeAll(items);
+    }
+    queue.takeAll(items);
+    for(auto& producer : producers){
+        producer.join();
+    }
+
+    ASSERT_EQ(items.size(), producersCount * itemsPerProducer);
+    // items of each producer come out in its push order
+    std::vector<int> nextItems(producersCount, 0);
+    for(auto item : items){
+        auto producerIndex = item / itemsPerProducer;
+        EXPECT_EQ(item % itemsPerProducer, nextItems[producerIndex]);
+        ++nextItems[producerIndex];
+    }
+}
+
+
+#endif // WRITE_BEHIND_QUEUE_TEST_H